@@ -0,0 +1,115 @@
+// End-to-end throughput of the HTTP stack over loopback connections: parsing, routing, middleware,
+// serialization and the server's connection logic, without sockets or syscalls in the way.
+#include <cache.h>
+#include <config.h>
+#include <middleware.h>
+#include <parse.h>
+#include <response.h>
+#include <route.h>
+#include <server.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+namespace {
+
+struct Scenario {
+  const char *name;
+  net::LoopbackScript script;
+  size_t requests; // per run of the script
+  net::Options options = {};
+};
+
+std::string request(std::string_view target, std::string_view extra = "") {
+  return "GET " + std::string(target) + " HTTP/1.1\r\nHost: localhost\r\nUser-Agent: bench/1.0\r\n" + std::string(extra) +
+         "\r\n";
+}
+
+// `per_chunk` requests arrive together; `total` requests in all
+net::LoopbackScript batched(const std::string &one, size_t per_chunk, size_t total) {
+  net::LoopbackScript script;
+  std::string chunk;
+  for (size_t i = 0; i < per_chunk; i++) {
+    chunk += one;
+  }
+  script.chunks.assign(total / per_chunk, chunk);
+  return script;
+}
+
+// Every request arrives in `pieces` reads
+net::LoopbackScript split(const std::string &one, size_t pieces, size_t total) {
+  net::LoopbackScript script;
+  size_t step = (one.size() + pieces - 1) / pieces;
+  for (size_t i = 0; i < total; i++) {
+    for (size_t offset = 0; offset < one.size(); offset += step) {
+      script.chunks.push_back(one.substr(offset, step));
+    }
+  }
+  return script;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  size_t total = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+  total = std::max<size_t>(total / 64 * 64, 64);
+
+  http::get("/echo/:content", [](const http::Request &req, http::Response &res) { res.send(req.params.at("content")); });
+  http::get(
+      "/cached/:content", [](const http::Request &req, http::Response &res) { res.send(req.params.at("content")); },
+      {.cache = http::CachePolicy{std::chrono::seconds(60), {}}});
+  http::get("/large", [](const http::Request &, http::Response &res) { res.send(std::string(64 * 1024, 'x')); });
+
+  http::ResponseCache cache(config::CACHE_CAPACITY);
+  http::Pipeline pipeline(http::KeepAlive{}, http::Cache{cache}, http::HeadMethod{}, http::Gzip{});
+  net::Handler handler = [&pipeline](std::string_view input, net::Output &out,
+                                     const net::RequestContext &) -> net::HandlerResult {
+    auto length = http::message_length(input);
+    if (!length) {
+      return {0, false};
+    }
+    auto request = http::parse_request(input.substr(0, *length));
+    http::Response response{};
+    if (!request) {
+      response.set_status(http::status::BAD_REQUEST);
+      response.write_to(out);
+      return {input.size(), true};
+    }
+    http::Exchange exchange{*request, response};
+    pipeline(exchange, http::dispatch);
+    if (exchange.serialized) {
+      http::write_cached(out, std::move(exchange.serialized));
+    } else {
+      response.write_to(out);
+    }
+    return {*length, exchange.close_connection};
+  };
+
+  auto echo = request("/echo/hello");
+  Scenario scenarios[] = {
+      {"keep-alive", batched(echo, 1, total), total},
+      {"pipelined x16", batched(echo, 16, total), total},
+      {"pipelined x16, edge-triggered", batched(echo, 16, total), total, {.edge_triggered = true}},
+      {"split reads x3", split(echo, 3, total), total},
+      {"cached", batched(request("/cached/hello"), 16, total), total},
+      {"gzip", batched(request("/echo/hello", "Accept-Encoding: gzip\r\n"), 16, total), total},
+      {"64 KiB bodies, slow reader", {batched(request("/large"), 1, total / 64).chunks, 4096}, total / 64},
+  };
+
+  std::cout << std::left << std::setw(32) << "scenario" << std::right << std::setw(14) << "requests/s"
+            << std::setw(14) << "MB/s out" << "\n";
+  for (auto &scenario : scenarios) {
+    net::Loopback loopback(scenario.options);
+    loopback.run(scenario.script, handler); // warm up pools and caches
+    auto start = std::chrono::steady_clock::now();
+    auto received = loopback.run(scenario.script, handler);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << std::left << std::setw(32) << scenario.name << std::right << std::fixed << std::setprecision(0)
+              << std::setw(14) << scenario.requests / elapsed.count() << std::setprecision(1) << std::setw(14)
+              << received.size() / elapsed.count() / 1e6 << "\n";
+  }
+  return 0;
+}
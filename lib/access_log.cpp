@@ -0,0 +1,209 @@
+#include "access_log.h"
+#include "types.h"
+
+#include <arpa/inet.h>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t DRAIN_BATCH = 256;
+constexpr auto IDLE_WAIT = std::chrono::milliseconds(5);
+
+std::atomic<uint64_t> next_log_id{1};
+
+std::string_view method_name(uint8_t method) {
+  switch (method) {
+  case static_cast<uint8_t>(http::Method::Get):
+    return "GET";
+  case static_cast<uint8_t>(http::Method::Post):
+    return "POST";
+  case static_cast<uint8_t>(http::Method::Head):
+    return "HEAD";
+  default:
+    return "-";
+  }
+}
+
+void append_peer(std::string &out, const net::PeerKey &peer) {
+  static constexpr uint8_t V4_MAPPED[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+  char buf[INET6_ADDRSTRLEN];
+  if (peer == net::PeerKey{}) {
+    out += '-'; // Unix domain socket
+  } else if (memcmp(peer.data(), V4_MAPPED, sizeof(V4_MAPPED)) == 0) {
+    out += inet_ntop(AF_INET, peer.data() + 12, buf, sizeof(buf));
+  } else {
+    out += inet_ntop(AF_INET6, peer.data(), buf, sizeof(buf));
+  }
+}
+
+void format(std::string &out, const http::AccessRecord &record) {
+  std::time_t seconds = record.time / 1000000;
+  struct tm tm;
+  gmtime_r(&seconds, &tm);
+  char time[40];
+  size_t n = strftime(time, sizeof(time), "%Y-%m-%dT%H:%M:%S", &tm);
+  snprintf(time + n, sizeof(time) - n, ".%06lldZ ", static_cast<long long>(record.time % 1000000));
+  out += time;
+  append_peer(out, record.peer);
+  out += ' ';
+  out += method_name(record.method);
+  out += ' ';
+  out.append(record.path, record.path_length);
+  out += ' ';
+  out += std::to_string(record.status);
+  out += ' ';
+  out += std::to_string(record.bytes);
+  out += ' ';
+  out += std::to_string(record.latency);
+  out += '\n';
+}
+
+bool write_all(int fd, struct iovec *iov, int iovcnt) {
+  while (iovcnt > 0) {
+    ssize_t n = writev(fd, iov, iovcnt);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    while (iovcnt > 0 && static_cast<size_t>(n) >= iov->iov_len) {
+      n -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = static_cast<char *>(iov->iov_base) + n;
+      iov->iov_len -= n;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+namespace http {
+
+AccessRing::AccessRing(size_t capacity) : slots(std::bit_ceil(std::max<size_t>(capacity, 2))), mask(slots.size() - 1) {}
+
+bool AccessRing::push(const AccessRecord &record) {
+  size_t h = head.load(std::memory_order_relaxed);
+  if (h - tail.load(std::memory_order_acquire) == slots.size()) {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  slots[h & mask] = record;
+  head.store(h + 1, std::memory_order_release);
+  return true;
+}
+
+size_t AccessRing::pop(AccessRecord *out, size_t max) {
+  size_t t = tail.load(std::memory_order_relaxed);
+  size_t n = std::min(head.load(std::memory_order_acquire) - t, max);
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = slots[(t + i) & mask];
+  }
+  tail.store(t + n, std::memory_order_release);
+  return n;
+}
+
+AccessLog::AccessLog(const std::string &path, size_t ring_capacity)
+    : fd(open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644)),
+      id(next_log_id.fetch_add(1, std::memory_order_relaxed)), ring_capacity(ring_capacity) {
+  if (fd < 0) {
+    std::cerr << "Failed to open access log " << path << "\n";
+    return;
+  }
+  drainer = std::thread([this] { run(); });
+}
+
+AccessLog::~AccessLog() {
+  if (fd < 0) {
+    return;
+  }
+  stopping.store(true, std::memory_order_relaxed);
+  drainer.join();
+  while (drain() > 0) {
+  }
+  close(fd);
+}
+
+void AccessLog::record(const AccessRecord &record) {
+  if (fd >= 0) {
+    thread_ring().push(record);
+  }
+}
+
+// The ring is looked up by log id, not address, so a new log at a reused address gets fresh rings
+AccessRing &AccessLog::thread_ring() {
+  thread_local uint64_t owner = 0;
+  thread_local AccessRing *ring = nullptr;
+  if (owner != id) {
+    auto created = std::make_unique<AccessRing>(ring_capacity);
+    ring = created.get();
+    owner = id;
+    std::lock_guard lock(rings_mutex);
+    rings.push_back(std::move(created));
+  }
+  return *ring;
+}
+
+void AccessLog::run() {
+  while (!stopping.load(std::memory_order_relaxed)) {
+    if (drain() == 0) {
+      std::this_thread::sleep_for(IDLE_WAIT);
+    }
+  }
+}
+
+// One pass over every ring: each non-empty batch becomes one iovec of formatted lines
+size_t AccessLog::drain() {
+  std::vector<AccessRing *> snapshot;
+  {
+    std::lock_guard lock(rings_mutex);
+    for (const auto &ring : rings) {
+      snapshot.push_back(ring.get());
+    }
+  }
+  AccessRecord batch[DRAIN_BATCH];
+  std::vector<std::string> chunks;
+  uint64_t dropped_now = 0;
+  size_t written = 0;
+  for (auto *ring : snapshot) {
+    dropped_now += ring->take_dropped();
+    size_t n = ring->pop(batch, DRAIN_BATCH);
+    if (n == 0) {
+      continue;
+    }
+    auto &chunk = chunks.emplace_back();
+    chunk.reserve(n * 96);
+    for (size_t i = 0; i < n; ++i) {
+      format(chunk, batch[i]);
+    }
+    written += n;
+  }
+  if (dropped_now > 0) {
+    total_dropped.fetch_add(dropped_now, std::memory_order_relaxed);
+    chunks.push_back("# dropped " + std::to_string(dropped_now) + " entries\n");
+  }
+  std::vector<struct iovec> iov;
+  iov.reserve(chunks.size());
+  for (auto &chunk : chunks) {
+    iov.push_back({chunk.data(), chunk.size()});
+  }
+  for (size_t i = 0; i < iov.size(); i += IOV_MAX) {
+    if (!write_all(fd, iov.data() + i, static_cast<int>(std::min<size_t>(IOV_MAX, iov.size() - i)))) {
+      break;
+    }
+  }
+  return written;
+}
+
+} // namespace http
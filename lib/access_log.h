@@ -0,0 +1,87 @@
+#pragma once
+
+#include "admission.h"
+#include "config.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace http {
+
+// One access log entry. Fixed size and trivially copyable, so logging is a copy into a ring slot;
+// formatting happens on the drain thread.
+struct AccessRecord {
+  static constexpr uint8_t NO_METHOD = 0xff; // the request did not parse
+
+  int64_t time = 0;     // microseconds since the epoch
+  uint64_t bytes = 0;   // response bytes queued
+  uint32_t latency = 0; // microseconds from reading the request to queueing the response
+  uint16_t status = 0;
+  uint8_t method = NO_METHOD; // http::Method
+  uint8_t path_length = 0;
+  net::PeerKey peer{};
+  char path[88];
+
+  // Long paths are truncated
+  void set_path(std::string_view value) {
+    path_length = static_cast<uint8_t>(std::min(value.size(), sizeof(path)));
+    memcpy(path, value.data(), path_length);
+  }
+};
+
+static_assert(sizeof(AccessRecord) == 128);
+
+// Single-producer, single-consumer ring. A full ring drops the record and counts it; neither side blocks.
+class AccessRing {
+public:
+  explicit AccessRing(size_t capacity); // rounded up to a power of two
+
+  bool push(const AccessRecord &record);
+  size_t pop(AccessRecord *out, size_t max);
+  uint64_t take_dropped() { return dropped.exchange(0, std::memory_order_relaxed); }
+
+private:
+  std::vector<AccessRecord> slots;
+  size_t mask;
+  alignas(64) std::atomic<size_t> head{0}; // next slot to write, advanced by the producer
+  alignas(64) std::atomic<size_t> tail{0}; // next slot to read, advanced by the consumer
+  alignas(64) std::atomic<uint64_t> dropped{0};
+};
+
+// Appends one line per request to a file:
+//   <ISO-8601 time> <client> <method> <path> <status> <bytes> <latency µs>
+// Every logging thread writes to its own ring; a background thread drains them all with batched writev.
+class AccessLog {
+public:
+  explicit AccessLog(const std::string &path, size_t ring_capacity = config::ACCESS_LOG_RING_SIZE);
+  // Drains what is left and stops the background thread
+  ~AccessLog();
+
+  bool is_open() const { return fd >= 0; }
+  void record(const AccessRecord &record);
+  // Entries dropped so far because a ring was full, as counted by the drain thread
+  uint64_t dropped() const { return total_dropped.load(std::memory_order_relaxed); }
+
+private:
+  AccessRing &thread_ring();
+  void run();
+  size_t drain();
+
+  int fd;
+  uint64_t id;
+  size_t ring_capacity;
+  std::mutex rings_mutex; // guards `rings`; taken once per thread and once per drain pass
+  std::vector<std::unique_ptr<AccessRing>> rings;
+  std::atomic<uint64_t> total_dropped{0};
+  std::atomic<bool> stopping{false};
+  std::thread drainer;
+};
+
+} // namespace http
@@ -0,0 +1,116 @@
+#include "admission.h"
+#include "config.h"
+
+#include <algorithm>
+#include <cstring>
+#include <netinet/in.h>
+
+namespace {
+
+// IPv6 clients typically hold a whole /64, so its addresses share one bucket. IPv4 (stored IPv4-mapped)
+// and Unix domain keys are used as they are.
+net::PeerKey bucket_key(net::PeerKey key) {
+  bool ipv4 = std::all_of(key.begin(), key.begin() + 10, [](uint8_t byte) { return byte == 0; }) &&
+              key[10] == 0xff && key[11] == 0xff;
+  if (!ipv4) {
+    std::fill(key.begin() + 8, key.end(), 0);
+  }
+  return key;
+}
+
+} // namespace
+
+namespace net {
+
+PeerKey peer_key(const sockaddr_storage &address) {
+  PeerKey key{};
+  if (address.ss_family == AF_INET) {
+    const auto *in4 = reinterpret_cast<const sockaddr_in *>(&address);
+    key[10] = key[11] = 0xff;
+    memcpy(key.data() + 12, &in4->sin_addr, 4);
+  } else if (address.ss_family == AF_INET6) {
+    const auto *in6 = reinterpret_cast<const sockaddr_in6 *>(&address);
+    memcpy(key.data(), &in6->sin6_addr, 16);
+  }
+  return key;
+}
+
+size_t Admission::PeerHash::operator()(const PeerKey &key) const {
+  uint64_t high, low;
+  memcpy(&high, key.data(), 8);
+  memcpy(&low, key.data() + 8, 8);
+  return std::hash<uint64_t>{}(high * 0x9e3779b97f4a7c15ULL ^ low);
+}
+
+Admission::Admission(AdmissionOptions opts)
+    : options(opts), concurrency_limit(static_cast<double>(opts.max_concurrency)) {}
+
+std::string_view Admission::overload_response() {
+  return "HTTP/1.1 503 Service Unavailable\r\n"
+         "Retry-After: 1\r\n"
+         "Content-Length: 0\r\n"
+         "Connection: close\r\n"
+         "\r\n";
+}
+
+Admission::Bucket &Admission::refill(const PeerKey &peer, Clock::time_point now) {
+  auto key = bucket_key(peer);
+  if (auto it = index.find(key); it != index.end()) {
+    buckets.splice(buckets.begin(), buckets, it->second);
+    auto &bucket = buckets.front();
+    std::chrono::duration<double> elapsed = now - bucket.updated;
+    bucket.tokens = std::min(options.burst, bucket.tokens + elapsed.count() * options.rate);
+    bucket.updated = now;
+    return bucket;
+  }
+  if (buckets.size() >= config::MAX_TRACKED_CLIENTS) {
+    // Constant work however many clients arrive: the least recently seen one's node is reused
+    index.erase(buckets.back().peer);
+    buckets.splice(buckets.begin(), buckets, std::prev(buckets.end()));
+    buckets.front() = Bucket{key, options.burst, now};
+  } else {
+    buckets.push_front(Bucket{key, options.burst, now});
+  }
+  index.emplace(key, buckets.begin());
+  return buckets.front();
+}
+
+void Admission::observe(Clock::duration delay, Clock::time_point now) {
+  min_delay = std::min(min_delay, delay);
+  if (now < interval_end) {
+    return;
+  }
+  if (interval_end != Clock::time_point{}) {
+    if (min_delay > options.target_delay) {
+      concurrency_limit = std::max<double>(options.min_concurrency, concurrency_limit * 0.9);
+    } else {
+      concurrency_limit = std::min<double>(options.max_concurrency, concurrency_limit + 1);
+    }
+  }
+  min_delay = Clock::duration::max();
+  interval_end = now + options.interval;
+}
+
+bool Admission::admit_connection(const PeerKey &peer, Clock::time_point now) {
+  return options.rate <= 0 || refill(peer, now).tokens >= 1;
+}
+
+bool Admission::admit_request(const PeerKey &peer, size_t in_flight, Clock::duration queue_delay,
+                              Clock::time_point now) {
+  if (options.max_concurrency > 0) {
+    observe(queue_delay, now);
+    if (in_flight >= limit()) {
+      return false;
+    }
+  }
+  if (options.rate > 0) {
+    auto &bucket = refill(peer, now);
+    if (bucket.tokens < 1) {
+      return false;
+    }
+    bucket.tokens -= 1;
+  }
+  return true;
+}
+
+} // namespace net
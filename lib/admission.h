@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <string_view>
+#include <sys/socket.h>
+#include <unordered_map>
+
+namespace net {
+
+// Client IP as 16 bytes (IPv4 is stored IPv4-mapped); all zero for Unix domain peers
+using PeerKey = std::array<uint8_t, 16>;
+
+PeerKey peer_key(const sockaddr_storage &address);
+
+struct AdmissionOptions {
+  double rate = 0;  // sustained requests per second per client IP, 0 disables rate limiting
+  double burst = 20; // bucket size
+  size_t max_concurrency = 0; // upper bound of the adaptive limit, 0 disables it
+  size_t min_concurrency = 4;
+  std::chrono::microseconds target_delay{5000}; // acceptable standing queueing delay
+  std::chrono::microseconds interval{100000};   // window over which the minimum delay is measured
+};
+
+// Overload protection: a token bucket per client IP plus a concurrency limit that shrinks while the
+// minimum queueing delay over an interval stays above target (a standing queue, as in CoDel) and
+// grows back by one per interval otherwise.
+class Admission {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit Admission(AdmissionOptions options = {});
+
+  bool enabled() const { return options.rate > 0 || options.max_concurrency > 0; }
+  // Refuses new connections from clients whose bucket is empty, without spending a token
+  bool admit_connection(const PeerKey &peer, Clock::time_point now);
+  // `in_flight` counts requests already admitted but not finished; `queue_delay` is how long the
+  // request waited in the event loop before being dispatched
+  bool admit_request(const PeerKey &peer, size_t in_flight, Clock::duration queue_delay, Clock::time_point now);
+  size_t limit() const { return static_cast<size_t>(concurrency_limit); }
+
+  // Pre-rendered `503 Service Unavailable` with Retry-After, sent when shedding
+  static std::string_view overload_response();
+
+private:
+  struct Bucket {
+    PeerKey peer;
+    double tokens;
+    Clock::time_point updated;
+  };
+
+  struct PeerHash {
+    size_t operator()(const PeerKey &key) const;
+  };
+
+  Bucket &refill(const PeerKey &peer, Clock::time_point now);
+  void observe(Clock::duration delay, Clock::time_point now);
+
+  AdmissionOptions options;
+  // At most MAX_TRACKED_CLIENTS, most recently seen first; the last is forgotten for a new client
+  std::list<Bucket> buckets;
+  std::unordered_map<PeerKey, std::list<Bucket>::iterator, PeerHash> index;
+  double concurrency_limit;
+  Clock::duration min_delay = Clock::duration::max();
+  Clock::time_point interval_end{};
+};
+
+} // namespace net
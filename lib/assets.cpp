@@ -0,0 +1,26 @@
+#include "assets.h"
+
+#include <algorithm>
+#include <array>
+
+namespace {
+
+#include "embedded_assets.inc"
+
+constexpr const http::Asset *lookup(std::string_view path) {
+  auto it = std::ranges::lower_bound(EMBEDDED_ASSETS, path, {}, &http::Asset::path);
+  return it != EMBEDDED_ASSETS.end() && it->path == path ? &*it : nullptr;
+}
+
+static_assert(std::ranges::is_sorted(EMBEDDED_ASSETS, {}, &http::Asset::path));
+static_assert(lookup("") == nullptr);
+
+} // namespace
+
+namespace http {
+
+std::span<const Asset> embedded_assets() { return EMBEDDED_ASSETS; }
+
+const Asset *find_asset(std::string_view path) { return lookup(path); }
+
+} // namespace http
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <span>
+#include <string_view>
+
+namespace http {
+
+// A file from assets/, embedded into the binary at build time by tools/embed_assets.cpp
+struct Asset {
+  std::string_view path; // relative to assets/
+  std::string_view data;
+  std::string_view gzip; // precompressed variant; empty when it would not be smaller
+  std::string_view etag;
+  std::string_view content_type;
+};
+
+// Sorted by path
+std::span<const Asset> embedded_assets();
+const Asset *find_asset(std::string_view path);
+
+} // namespace http
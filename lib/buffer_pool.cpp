@@ -0,0 +1,69 @@
+#include "buffer_pool.h"
+#include "config.h"
+
+#include <cstring>
+
+namespace {
+
+size_t size_class(size_t size) {
+  for (size_t i = 0; i < net::BufferPool::SIZE_CLASSES.size(); i++) {
+    if (size <= net::BufferPool::SIZE_CLASSES[i]) {
+      return i;
+    }
+  }
+  return net::BufferPool::SIZE_CLASSES.size();
+}
+
+} // namespace
+
+namespace net {
+
+BufferPool::~BufferPool() {
+  for (auto &list : free_lists) {
+    for (char *data : list) {
+      delete[] data;
+    }
+  }
+}
+
+Buffer BufferPool::acquire(size_t size) {
+  size_t index = size_class(size);
+  if (index == SIZE_CLASSES.size()) {
+    return {};
+  }
+  auto &list = free_lists[index];
+  if (list.empty()) {
+    return {new char[SIZE_CLASSES[index]], SIZE_CLASSES[index]};
+  }
+  char *data = list.back();
+  list.pop_back();
+  return {data, SIZE_CLASSES[index]};
+}
+
+void BufferPool::release(Buffer &buffer) {
+  if (!buffer) {
+    return;
+  }
+  auto &list = free_lists[size_class(buffer.capacity)];
+  if (list.size() * buffer.capacity < config::POOL_RETAIN_BYTES) {
+    list.push_back(buffer.data);
+  } else {
+    delete[] buffer.data;
+  }
+  buffer = {};
+}
+
+bool BufferPool::grow(Buffer &buffer, size_t used, size_t size) {
+  Buffer larger = acquire(size);
+  if (!larger) {
+    return false;
+  }
+  if (used > 0) {
+    memcpy(larger.data, buffer.data, used);
+  }
+  release(buffer);
+  buffer = larger;
+  return true;
+}
+
+} // namespace net
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace net {
+
+struct Buffer {
+  char *data = nullptr;
+  uint32_t capacity = 0;
+
+  explicit operator bool() const { return data != nullptr; }
+};
+
+// Free lists of fixed size classes. Buffers are only allocated while the pool warms up;
+// afterwards acquire/release just move pointers. Each class retains a bounded number of spares.
+class BufferPool {
+public:
+  static constexpr std::array<uint32_t, 5> SIZE_CLASSES = {4 << 10, 16 << 10, 64 << 10, 256 << 10, 1 << 20};
+
+  BufferPool() = default;
+  BufferPool(const BufferPool &) = delete;
+  BufferPool &operator=(const BufferPool &) = delete;
+  ~BufferPool();
+
+  // Smallest class holding `size` bytes; an empty buffer if `size` exceeds the largest class
+  Buffer acquire(size_t size);
+  void release(Buffer &buffer);
+  // Moves the first `used` bytes into a buffer of at least `size` bytes; fails if none is large enough
+  bool grow(Buffer &buffer, size_t used, size_t size);
+
+private:
+  std::array<std::vector<char *>, SIZE_CLASSES.size()> free_lists;
+};
+
+} // namespace net
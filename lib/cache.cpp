@@ -0,0 +1,103 @@
+#include "cache.h"
+#include "config.h"
+
+#include <algorithm>
+#include <functional>
+
+using namespace std;
+
+namespace {
+
+constexpr size_t MAX_VARIANTS = 8;
+
+string primary_key(const http::Request &request) {
+  string key;
+  key.reserve(request.requestLine.uri.size() + 2);
+  key += static_cast<char>('0' + static_cast<int>(request.requestLine.method));
+  key += ' ';
+  key += request.requestLine.uri;
+  return key;
+}
+
+string variant_key(const http::Request &request, const vector<string> &vary, string_view encoding) {
+  string key(encoding);
+  for (const auto &name : vary) {
+    key += '\n';
+    auto it = request.headers.data.find(name);
+    if (it != request.headers.data.end()) {
+      key += it->second;
+    }
+  }
+  return key;
+}
+
+} // namespace
+
+namespace http {
+
+ResponseCache::ResponseCache(size_t capacity, size_t shard_count)
+    : shard_capacity(max<size_t>(1, capacity / shard_count)), shards(shard_count) {}
+
+ResponseCache::Shard &ResponseCache::shard_for(const string &key) { return shards[hash<string>{}(key) % shards.size()]; }
+
+ResponseCache::Bytes ResponseCache::lookup(const Request &request, string_view encoding) {
+  auto key = primary_key(request);
+  auto &shard = shard_for(key);
+  lock_guard lock(shard.mutex);
+
+  auto it = shard.index.find(key);
+  if (it == shard.index.end()) {
+    return nullptr;
+  }
+  auto &entry = *it->second;
+  auto vkey = variant_key(request, entry.vary, encoding);
+  auto variant = ranges::find(entry.variants, vkey, &Variant::key);
+  if (variant == entry.variants.end()) {
+    return nullptr;
+  }
+  if (variant->expires <= Clock::now()) {
+    entry.variants.erase(variant);
+    return nullptr;
+  }
+  shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+  return variant->bytes;
+}
+
+ResponseCache::Bytes ResponseCache::store(const Request &request, string_view encoding, const CachePolicy &policy,
+                                          string bytes) {
+  if (bytes.size() > config::CACHE_MAX_ENTRY_SIZE) {
+    return make_shared<const string>(std::move(bytes));
+  }
+  auto key = primary_key(request);
+  auto &shard = shard_for(key);
+  auto vkey = variant_key(request, policy.vary, encoding);
+  auto stored = make_shared<const string>(std::move(bytes));
+  Variant variant{std::move(vkey), stored, Clock::now() + policy.ttl};
+  lock_guard lock(shard.mutex);
+
+  auto it = shard.index.find(key);
+  if (it == shard.index.end()) {
+    shard.lru.push_front(Entry{key, policy.vary, {}});
+    it = shard.index.emplace(std::move(key), shard.lru.begin()).first;
+    if (shard.lru.size() > shard_capacity) {
+      shard.index.erase(shard.lru.back().key);
+      shard.lru.pop_back();
+    }
+  } else {
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+  }
+
+  auto &entry = *it->second;
+  auto existing = ranges::find(entry.variants, variant.key, &Variant::key);
+  if (existing != entry.variants.end()) {
+    *existing = std::move(variant);
+    return stored;
+  }
+  if (entry.variants.size() >= MAX_VARIANTS) {
+    entry.variants.erase(entry.variants.begin());
+  }
+  entry.variants.push_back(std::move(variant));
+  return stored;
+}
+
+} // namespace http
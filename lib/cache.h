@@ -0,0 +1,58 @@
+#pragma once
+
+#include "types.h"
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace http {
+
+struct CachePolicy {
+  std::chrono::milliseconds ttl;
+  std::vector<std::string> vary; // request headers that select a variant
+};
+
+// Sharded LRU of serialized responses (all but the status line and Date), keyed by method + uri, with
+// variants selected by the policy's `vary` headers and the content encoding.
+class ResponseCache {
+public:
+  using Bytes = std::shared_ptr<const std::string>;
+
+  explicit ResponseCache(size_t capacity, size_t shard_count = 16);
+
+  Bytes lookup(const Request &request, std::string_view encoding);
+  // Returns the stored bytes so the caller can send them without another copy
+  Bytes store(const Request &request, std::string_view encoding, const CachePolicy &policy, std::string bytes);
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Variant {
+    std::string key;
+    Bytes bytes;
+    Clock::time_point expires;
+  };
+
+  struct Entry {
+    std::string key;
+    std::vector<std::string> vary;
+    std::vector<Variant> variants;
+  };
+
+  struct Shard {
+    std::mutex mutex;
+    std::list<Entry> lru; // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+  };
+
+  Shard &shard_for(const std::string &key);
+
+  size_t shard_capacity;
+  std::vector<Shard> shards;
+};
+
+} // namespace http
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
 
@@ -9,6 +10,27 @@ constexpr uint16_t PORT = 4221;
 constexpr int BUFFER_SIZE = 4096;
 constexpr int CONNECTION_BACKLOG = 5;
 constexpr int MAX_EVENTS = 64;
+constexpr int MAX_IOVECS = 64;
+constexpr size_t MAX_CONNECTIONS = 1 << 18;
+// Pipelined requests stop being processed once this much output is waiting to be written
+constexpr size_t MAX_PENDING_OUTPUT = 1 << 20;
+// Spare bytes each buffer pool size class keeps for reuse
+constexpr size_t POOL_RETAIN_BYTES = 8 << 20;
+// Released connection output buffers kept for reuse, each trimmed back to BUFFER_SIZE
+constexpr size_t SPARE_OUTPUTS = 256;
+// Rate-limit buckets kept before the least recently seen clients are forgotten
+constexpr size_t MAX_TRACKED_CLIENTS = 1 << 16;
+constexpr size_t CACHE_CAPACITY = 1024;
+constexpr size_t CACHE_MAX_ENTRY_SIZE = 64 * 1024;
+constexpr size_t MAX_RANGES = 16;
+// Request limits, checked as soon as the head has arrived (must fit the largest pooled buffer)
+constexpr size_t MAX_HEADER_SIZE = 8 * 1024;
+constexpr size_t MAX_BODY_SIZE = 512 * 1024;
+// Bodies up to this size are copied next to their head; larger ones are moved or sent with sendfile
+constexpr size_t INLINE_BODY_SIZE = 1024;
+constexpr size_t SENDFILE_THRESHOLD = 64 * 1024;
+// Access log records buffered per logging thread before entries are dropped
+constexpr size_t ACCESS_LOG_RING_SIZE = 4096;
 
 inline std::string directory;
 
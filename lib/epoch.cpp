@@ -0,0 +1,83 @@
+#include "epoch.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+std::atomic<uint64_t> next_domain_id{1};
+
+} // namespace
+
+namespace http {
+
+EpochDomain::Guard::Guard(EpochDomain &domain) : slot(&domain.thread_slot()) {
+  if (slot->depth++ == 0) {
+    slot->epoch.store(domain.epoch.load());
+    // The pin must be visible before any pointer the reader goes on to load. A seq_cst store alone
+    // does not order later acquire loads of other atomics, so the fence does, whatever order the
+    // reader loads with.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+}
+
+EpochDomain::Guard::~Guard() {
+  if (--slot->depth == 0) {
+    slot->epoch.store(0, std::memory_order_release);
+  }
+}
+
+EpochDomain::EpochDomain() : id(next_domain_id.fetch_add(1, std::memory_order_relaxed)) {}
+
+EpochDomain::~EpochDomain() {
+  for (auto &[tag, deleter] : retired) {
+    deleter();
+  }
+}
+
+// Looked up by domain id, not address, so a domain created at a reused address gets fresh slots
+EpochDomain::Slot &EpochDomain::thread_slot() {
+  thread_local std::vector<std::pair<uint64_t, Slot *>> owned;
+  for (const auto &[owner, slot] : owned) {
+    if (owner == id) {
+      return *slot;
+    }
+  }
+  std::lock_guard lock(mutex);
+  auto &slot = slots.emplace_back();
+  owned.emplace_back(id, &slot);
+  return slot;
+}
+
+void EpochDomain::retire(std::function<void()> deleter) {
+  std::lock_guard lock(mutex);
+  // A reader that loaded the old pointer pinned an epoch older than `tag`
+  uint64_t tag = epoch.fetch_add(1) + 1;
+  retired.emplace_back(tag, std::move(deleter));
+  reclaim();
+}
+
+size_t EpochDomain::pending() {
+  std::lock_guard lock(mutex);
+  reclaim();
+  return retired.size();
+}
+
+void EpochDomain::reclaim() {
+  uint64_t oldest = std::numeric_limits<uint64_t>::max();
+  for (const auto &slot : slots) {
+    uint64_t pinned = slot.epoch.load();
+    if (pinned != 0) {
+      oldest = std::min(oldest, pinned);
+    }
+  }
+  auto freed = std::stable_partition(retired.begin(), retired.end(), [oldest](const auto &entry) {
+    return entry.first > oldest;
+  });
+  for (auto it = freed; it != retired.end(); ++it) {
+    it->second();
+  }
+  retired.erase(freed, retired.end());
+}
+
+} // namespace http
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace http {
+
+// Epoch-based reclamation. Readers pin the current epoch while they hold pointers to shared data;
+// a retired object is freed once every reader that could still see it has unpinned. Pinning is two
+// atomic stores and never blocks; retiring takes a mutex.
+class EpochDomain {
+  struct Slot {
+    std::atomic<uint64_t> epoch{0}; // epoch pinned by the owning thread, 0 while quiescent
+    uint32_t depth = 0;             // nested guards on the owning thread
+  };
+
+public:
+  // Pins the calling thread for its lifetime; guards nest
+  class Guard {
+  public:
+    explicit Guard(EpochDomain &domain);
+    ~Guard();
+    Guard(const Guard &) = delete;
+    Guard &operator=(const Guard &) = delete;
+
+  private:
+    Slot *slot;
+  };
+
+  EpochDomain();
+  // Frees whatever is still retired; no reader may be pinned
+  ~EpochDomain();
+
+  // Runs `deleter` once no reader pinned before this call remains pinned
+  void retire(std::function<void()> deleter);
+  // Retired objects not yet freed
+  size_t pending();
+
+private:
+  Slot &thread_slot();
+  void reclaim();
+
+  uint64_t id;
+  std::atomic<uint64_t> epoch{1};
+  std::mutex mutex;       // guards `slots` growth and `retired`
+  std::deque<Slot> slots; // one per thread that ever pinned; never shrinks
+  std::vector<std::pair<uint64_t, std::function<void()>>> retired;
+};
+
+} // namespace http
@@ -0,0 +1,169 @@
+#include "event_stream.h"
+#include "route.h"
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+namespace http {
+
+namespace {
+
+struct Subscriber {
+  net::ConnectionHandle handle;
+  deque<shared_ptr<const string>> queue; // published, not yet handed to the connection
+  bool overflowed = false;
+  size_t index = 0; // position in EventStreamState::subscribers
+};
+
+} // namespace
+
+struct EventStreamState {
+  EventStreamOptions options;
+  mutable mutex lock;
+  vector<Subscriber *> subscribers;
+};
+
+namespace {
+
+class EventStreamSession : public net::Session {
+public:
+  explicit EventStreamSession(shared_ptr<EventStreamState> state) : state(std::move(state)) {}
+
+  ~EventStreamSession() override {
+    if (!subscribed) {
+      return;
+    }
+    lock_guard guard(state->lock);
+    auto &subscribers = state->subscribers;
+    subscribers[subscriber.index] = subscribers.back();
+    subscribers[subscriber.index]->index = subscriber.index;
+    subscribers.pop_back();
+  }
+
+  void on_open(net::Output &, net::ConnectionHandle handle) override {
+    lock_guard guard(state->lock);
+    subscriber.handle = handle;
+    subscriber.index = state->subscribers.size();
+    state->subscribers.push_back(&subscriber);
+    subscribed = true;
+  }
+
+  // Clients have nothing to say on an event stream
+  net::HandlerResult on_input(span<char> input, net::Output &) override { return {input.size(), false}; }
+
+  bool on_wake(net::Output &output, bool backlogged) override {
+    lock_guard guard(state->lock);
+    if (subscriber.overflowed) {
+      return true;
+    }
+    if (backlogged) {
+      return false;
+    }
+    for (auto &event : subscriber.queue) {
+      output.append(std::move(event));
+    }
+    subscriber.queue.clear();
+    return false;
+  }
+
+private:
+  shared_ptr<EventStreamState> state;
+  Subscriber subscriber;
+  bool subscribed = false;
+};
+
+// A line break inside `event` or `id` would start a field of the client's choosing, so they are dropped
+void append_field(string &out, string_view name, string_view value) {
+  out += name;
+  out += ": ";
+  for (char c : value) {
+    if (c != '\r' && c != '\n') {
+      out += c;
+    }
+  }
+  out += '\n';
+}
+
+} // namespace
+
+string format_event(const Event &event) {
+  string out;
+  out.reserve(event.data.size() + event.event.size() + event.id.size() + 32);
+  if (!event.id.empty()) {
+    append_field(out, "id", event.id);
+  }
+  if (!event.event.empty()) {
+    append_field(out, "event", event.event);
+  }
+  // Clients end a line at CRLF, a lone CR or LF; each becomes its own `data:` line
+  string_view data = event.data;
+  while (true) {
+    size_t newline = data.find_first_of("\r\n");
+    out += "data: ";
+    out += data.substr(0, newline);
+    out += '\n';
+    if (newline == string_view::npos) {
+      break;
+    }
+    data.remove_prefix(data.substr(newline).starts_with("\r\n") ? newline + 2 : newline + 1);
+  }
+  out += '\n';
+  return out;
+}
+
+EventStream::EventStream(EventStreamOptions options) : state(make_shared<EventStreamState>()) {
+  state->options = options;
+}
+
+void EventStream::publish(const Event &event) {
+  auto bytes = make_shared<const string>(format_event(event));
+  vector<net::ConnectionHandle> wakeups;
+  {
+    lock_guard guard(state->lock);
+    const auto &options = state->options;
+    for (auto *subscriber : state->subscribers) {
+      auto &queue = subscriber->queue;
+      if (queue.size() >= options.max_queued) {
+        if (options.policy == SlowSubscriber::Coalesce) {
+          queue.pop_front();
+        } else {
+          if (!subscriber->overflowed) {
+            subscriber->overflowed = true;
+            wakeups.push_back(subscriber->handle);
+          }
+          continue;
+        }
+      }
+      // A non-empty queue already has a wakeup on its way or waits for the connection to drain
+      if (queue.empty()) {
+        wakeups.push_back(subscriber->handle);
+      }
+      queue.push_back(bytes);
+    }
+  }
+  net::wake(wakeups);
+}
+
+size_t EventStream::subscribers() const {
+  lock_guard guard(state->lock);
+  return state->subscribers.size();
+}
+
+unique_ptr<net::Session> EventStream::subscribe() const { return make_unique<EventStreamSession>(state); }
+
+void sse(string route, EventStream stream) {
+  create_route(
+      Method::Get, std::move(route),
+      [](const Request &, Response &res) {
+        res.set_status(status::OK);
+        res.headers.set("Content-Type", "text/event-stream");
+        res.headers.set("Cache-Control", "no-cache");
+        res.streaming = true;
+      },
+      {.upgrade = [stream](const Request &) { return stream.subscribe(); }});
+}
+
+} // namespace http
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "session.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace http {
+
+// What happens to a subscriber whose connection cannot keep up
+enum class SlowSubscriber {
+  Disconnect, // dropped once `max_queued` events wait for it
+  Coalesce,   // only the newest `max_queued` events are kept
+};
+
+struct EventStreamOptions {
+  // Events held for one subscriber while its connection is still writing earlier ones
+  size_t max_queued = 64;
+  SlowSubscriber policy = SlowSubscriber::Disconnect;
+};
+
+struct Event {
+  std::string_view data;
+  std::string_view event = {}; // `event:` field, omitted when empty
+  std::string_view id = {};    // `id:` field, omitted when empty
+};
+
+// One event in text/event-stream format: a `data:` line per line of `data` (split at CRLF, CR or LF),
+// ended by a blank line. Line breaks in `event` and `id` are removed.
+std::string format_event(const Event &event);
+
+struct EventStreamState;
+
+// A broadcast channel. Each published event is serialized once into a shared buffer, and every
+// subscriber's output queues a reference to it. Copies of an EventStream publish to the same
+// subscribers.
+class EventStream {
+public:
+  explicit EventStream(EventStreamOptions options = {});
+
+  // Callable from any thread
+  void publish(const Event &event);
+  size_t subscribers() const;
+  // The session for a new subscriber; it joins the stream once its connection opens
+  std::unique_ptr<net::Session> subscribe() const;
+
+private:
+  std::shared_ptr<EventStreamState> state;
+};
+
+// Registers a GET route answering `200 text/event-stream` that then carries everything published
+// on `stream` until the client disconnects
+void sse(std::string route, EventStream stream);
+
+} // namespace http
@@ -0,0 +1,479 @@
+#include "hpack.h"
+
+#include <algorithm>
+#include <array>
+#include <optional>
+
+using namespace std;
+
+namespace http::hpack {
+
+namespace {
+
+struct StaticEntry {
+  string_view name;
+  string_view value;
+};
+
+// RFC 7541 Appendix A; index 1 is the first entry
+constexpr array<StaticEntry, 61> STATIC_TABLE = {{
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"via", ""},
+    {"vary", ""},
+    {"www-authenticate", ""},
+}};
+
+struct HuffmanCode {
+  uint32_t code;
+  uint8_t bits;
+};
+
+// RFC 7541 Appendix B, by symbol; EOS (256) is 30 one bits and never encoded
+constexpr array<HuffmanCode, 256> HUFFMAN_CODES = {{
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+    {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+    {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+    {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+    {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+    {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+    {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+    {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+    {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+    {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+    {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+    {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+    {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+    {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+    {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+    {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+    {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+    {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+    {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+    {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+    {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+    {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+    {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+    {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+    {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+    {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+    {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+    {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+    {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+    {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+    {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+    {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+    {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+}};
+
+// Byte-at-a-time decoding: each table maps the next 8 input bits to either a symbol and its code
+// length, or (for codes longer than 8 bits) the table that continues the code.
+struct HuffmanTables {
+  struct Entry {
+    uint16_t next = 0; // table index when `bits` is 0
+    uint8_t symbol = 0;
+    uint8_t bits = 0; // code bits consumed from this table's byte
+  };
+  vector<array<Entry, 256>> tables;
+
+  HuffmanTables() {
+    tables.emplace_back();
+    for (size_t symbol = 0; symbol < HUFFMAN_CODES.size(); symbol++) {
+      auto [code, bits] = HUFFMAN_CODES[symbol];
+      size_t table = 0;
+      while (bits > 8) {
+        bits -= 8;
+        auto &entry = tables[table][(code >> bits) & 0xff];
+        if (entry.next == 0) {
+          entry.next = static_cast<uint16_t>(tables.size());
+          tables.emplace_back();
+        }
+        table = entry.next;
+      }
+      // Every byte that starts with the remaining code bits decodes to this symbol
+      size_t shift = 8 - bits;
+      size_t start = (code << shift) & 0xff;
+      for (size_t i = start; i < start + (size_t(1) << shift); i++) {
+        tables[table][i] = {0, static_cast<uint8_t>(symbol), bits};
+      }
+    }
+  }
+};
+
+const HuffmanTables &huffman_tables() {
+  static const HuffmanTables tables;
+  return tables;
+}
+
+expected<uint64_t, Error> decode_integer(string_view &in, int prefix_bits) {
+  if (in.empty()) {
+    return unexpected(Error::Truncated);
+  }
+  uint64_t max_prefix = (uint64_t(1) << prefix_bits) - 1;
+  uint64_t value = static_cast<uint8_t>(in[0]) & max_prefix;
+  in.remove_prefix(1);
+  if (value < max_prefix) {
+    return value;
+  }
+  for (int shift = 0;; shift += 7) {
+    if (in.empty()) {
+      return unexpected(Error::Truncated);
+    }
+    if (shift > 56) {
+      return unexpected(Error::IntegerOverflow);
+    }
+    auto byte = static_cast<uint8_t>(in[0]);
+    in.remove_prefix(1);
+    value += uint64_t(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return value;
+    }
+  }
+}
+
+void encode_integer(string &out, uint8_t first, int prefix_bits, uint64_t value) {
+  uint64_t max_prefix = (uint64_t(1) << prefix_bits) - 1;
+  if (value < max_prefix) {
+    out += static_cast<char>(first | value);
+    return;
+  }
+  out += static_cast<char>(first | max_prefix);
+  value -= max_prefix;
+  while (value >= 0x80) {
+    out += static_cast<char>((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  out += static_cast<char>(value);
+}
+
+expected<string, Error> decode_string(string_view &in) {
+  if (in.empty()) {
+    return unexpected(Error::Truncated);
+  }
+  bool huffman = static_cast<uint8_t>(in[0]) & 0x80;
+  auto length = decode_integer(in, 7);
+  if (!length) {
+    return unexpected(length.error());
+  }
+  if (*length > in.size()) {
+    return unexpected(Error::Truncated);
+  }
+  string_view bytes = in.substr(0, *length);
+  in.remove_prefix(*length);
+  if (huffman) {
+    return huffman_decode(bytes);
+  }
+  return string(bytes);
+}
+
+void encode_string(string &out, string_view value) {
+  size_t huffman_size = huffman_encoded_size(value);
+  if (huffman_size < value.size()) {
+    encode_integer(out, 0x80, 7, huffman_size);
+    huffman_encode(value, out);
+  } else {
+    encode_integer(out, 0, 7, value.size());
+    out += value;
+  }
+}
+
+constexpr size_t ENTRY_OVERHEAD = 32;
+
+} // namespace
+
+expected<string, Error> huffman_decode(string_view in) {
+  const auto &tables = huffman_tables().tables;
+  string out;
+  out.reserve(in.size() * 8 / 5);
+  uint64_t bits = 0; // pending input bits, right-aligned
+  size_t count = 0;  // how many
+  size_t table = 0;
+  for (char c : in) {
+    bits = bits << 8 | static_cast<uint8_t>(c);
+    count += 8;
+    while (count >= 8) {
+      const auto &entry = tables[table][(bits >> (count - 8)) & 0xff];
+      if (entry.bits == 0) {
+        if (entry.next == 0) {
+          return unexpected(Error::InvalidHuffman); // EOS or beyond
+        }
+        table = entry.next;
+        count -= 8;
+        continue;
+      }
+      out += static_cast<char>(entry.symbol);
+      count -= entry.bits;
+      table = 0;
+    }
+  }
+  // Codes shorter than the bits left over can still complete
+  while (count > 0 && table == 0) {
+    const auto &entry = tables[0][(bits << (8 - count)) & 0xff];
+    if (entry.bits == 0 || entry.bits > count) {
+      break;
+    }
+    out += static_cast<char>(entry.symbol);
+    count -= entry.bits;
+  }
+  // What remains must be padding: fewer than 8 bits, all ones (a prefix of EOS)
+  uint64_t mask = (uint64_t(1) << count) - 1;
+  if (table != 0 || count > 7 || (bits & mask) != mask) {
+    return unexpected(Error::InvalidHuffman);
+  }
+  return out;
+}
+
+size_t huffman_encoded_size(string_view in) {
+  size_t bits = 0;
+  for (char c : in) {
+    bits += HUFFMAN_CODES[static_cast<uint8_t>(c)].bits;
+  }
+  return (bits + 7) / 8;
+}
+
+void huffman_encode(string_view in, string &out) {
+  uint64_t bits = 0;
+  size_t count = 0;
+  for (char c : in) {
+    auto [code, length] = HUFFMAN_CODES[static_cast<uint8_t>(c)];
+    bits = bits << length | code;
+    count += length;
+    while (count >= 8) {
+      count -= 8;
+      out += static_cast<char>(bits >> count);
+    }
+  }
+  if (count > 0) {
+    // Pad with the most significant bits of EOS
+    out += static_cast<char>(bits << (8 - count) | (0xff >> count));
+  }
+}
+
+optional<HeaderField> Decoder::lookup(uint64_t index) const {
+  if (index == 0) {
+    return nullopt;
+  }
+  if (index <= STATIC_TABLE.size()) {
+    const auto &entry = STATIC_TABLE[index - 1];
+    return HeaderField{string(entry.name), string(entry.value)};
+  }
+  index -= STATIC_TABLE.size() + 1;
+  if (index >= table.size()) {
+    return nullopt;
+  }
+  return table[index];
+}
+
+bool Decoder::has_index(uint64_t index) const { return index > 0 && index <= STATIC_TABLE.size() + table.size(); }
+
+void Decoder::evict(size_t limit) {
+  while (size > limit) {
+    size -= table.back().name.size() + table.back().value.size() + ENTRY_OVERHEAD;
+    table.pop_back();
+  }
+}
+
+void Decoder::insert(HeaderField field) {
+  size_t entry_size = field.name.size() + field.value.size() + ENTRY_OVERHEAD;
+  // An entry larger than the table empties it and is not added
+  evict(entry_size > table_size_limit ? 0 : table_size_limit - entry_size);
+  if (entry_size <= table_size_limit) {
+    size += entry_size;
+    table.push_front(std::move(field));
+  }
+}
+
+expected<vector<HeaderField>, Error> Decoder::decode(string_view block) {
+  vector<HeaderField> fields;
+  size_t list_size = 0;
+  // Counts a field against the limit; false once it is exceeded and fields are dropped
+  auto admit = [&](const HeaderField &field) {
+    list_size += field.name.size() + field.value.size() + ENTRY_OVERHEAD;
+    if (list_size > max_list_size) {
+      fields.clear();
+      return false;
+    }
+    return true;
+  };
+  while (!block.empty()) {
+    auto first = static_cast<uint8_t>(block[0]);
+    if (first & 0x80) {
+      // Indexed field
+      auto index = decode_integer(block, 7);
+      if (!index) {
+        return unexpected(index.error());
+      }
+      if (list_size > max_list_size) {
+        if (!has_index(*index)) {
+          return unexpected(Error::InvalidIndex);
+        }
+        continue;
+      }
+      auto field = lookup(*index);
+      if (!field) {
+        return unexpected(Error::InvalidIndex);
+      }
+      if (admit(*field)) {
+        fields.push_back(std::move(*field));
+      }
+      continue;
+    }
+    if ((first & 0xe0) == 0x20) {
+      // Dynamic table size update
+      auto limit = decode_integer(block, 5);
+      if (!limit) {
+        return unexpected(limit.error());
+      }
+      if (*limit > max_table_size) {
+        return unexpected(Error::TableSizeExceeded);
+      }
+      table_size_limit = *limit;
+      evict(table_size_limit);
+      continue;
+    }
+    // Literal: with incremental indexing (01), without indexing (0000) or never indexed (0001)
+    bool indexing = (first & 0xc0) == 0x40;
+    auto name_index = decode_integer(block, indexing ? 6 : 4);
+    if (!name_index) {
+      return unexpected(name_index.error());
+    }
+    HeaderField field;
+    if (*name_index == 0) {
+      auto name = decode_string(block);
+      if (!name) {
+        return unexpected(name.error());
+      }
+      field.name = std::move(*name);
+    } else {
+      auto named = lookup(*name_index);
+      if (!named) {
+        return unexpected(Error::InvalidIndex);
+      }
+      field.name = std::move(named->name);
+    }
+    auto value = decode_string(block);
+    if (!value) {
+      return unexpected(value.error());
+    }
+    field.value = std::move(*value);
+    if (indexing) {
+      insert(field);
+    }
+    if (list_size <= max_list_size && admit(field)) {
+      fields.push_back(std::move(field));
+    }
+  }
+  if (list_size > max_list_size) {
+    return unexpected(Error::HeaderListTooLarge);
+  }
+  return fields;
+}
+
+void encode_field(string &out, string_view name, string_view value) {
+  size_t name_index = 0;
+  for (size_t i = 0; i < STATIC_TABLE.size(); i++) {
+    if (STATIC_TABLE[i].name == name) {
+      if (STATIC_TABLE[i].value == value && !value.empty()) {
+        encode_integer(out, 0x80, 7, i + 1);
+        return;
+      }
+      if (name_index == 0) {
+        name_index = i + 1;
+      }
+    }
+  }
+  encode_integer(out, 0x00, 4, name_index);
+  if (name_index == 0) {
+    encode_string(out, name);
+  }
+  encode_string(out, value);
+}
+
+} // namespace http::hpack
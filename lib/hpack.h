@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <expected>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// HPACK header compression for HTTP/2 (RFC 7541)
+namespace http::hpack {
+
+struct HeaderField {
+  std::string name;
+  std::string value;
+};
+
+enum class Error { Truncated, InvalidIndex, InvalidHuffman, IntegerOverflow, TableSizeExceeded, HeaderListTooLarge };
+
+// Huffman coding of string literals with the code from RFC 7541 Appendix B
+std::expected<std::string, Error> huffman_decode(std::string_view in);
+void huffman_encode(std::string_view in, std::string &out);
+size_t huffman_encoded_size(std::string_view in);
+
+// Decodes the header blocks of one connection. The dynamic table carries over between blocks, so
+// every block must be decoded in order, including those of streams that are then refused.
+class Decoder {
+public:
+  // `max_table_size` is the SETTINGS_HEADER_TABLE_SIZE this endpoint advertised, `max_list_size` its
+  // SETTINGS_MAX_HEADER_LIST_SIZE
+  explicit Decoder(size_t max_table_size = 4096, size_t max_list_size = SIZE_MAX)
+      : max_table_size(max_table_size), table_size_limit(max_table_size), max_list_size(max_list_size) {}
+
+  // A block whose fields add up to more than `max_list_size` (name + value + 32 each) fails with
+  // HeaderListTooLarge. Small references to large table entries would otherwise expand without bound;
+  // past the limit fields are no longer copied, but the block is still applied to the dynamic table, so
+  // the connection stays usable.
+  std::expected<std::vector<HeaderField>, Error> decode(std::string_view block);
+  size_t table_size() const { return size; }
+
+private:
+  std::optional<HeaderField> lookup(uint64_t index) const;
+  bool has_index(uint64_t index) const;
+  void insert(HeaderField field);
+  void evict(size_t limit);
+
+  size_t max_table_size;
+  size_t table_size_limit; // lowered by the encoder with dynamic table size updates
+  size_t max_list_size;
+  std::deque<HeaderField> table; // newest first
+  size_t size = 0;               // RFC 7541 size: name + value + 32 per entry
+};
+
+// Appends one header field without touching the dynamic table (literal without indexing), naming it
+// by static table index where possible and Huffman-coding strings that shrink. `name` must be lowercase.
+void encode_field(std::string &out, std::string_view name, std::string_view value);
+
+} // namespace http::hpack
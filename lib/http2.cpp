@@ -0,0 +1,770 @@
+#include "http2.h"
+#include "config.h"
+
+#include <algorithm>
+#include <cctype>
+#include <ctime>
+#include <map>
+#include <variant>
+
+using namespace std;
+
+namespace http {
+
+namespace h2 {
+
+optional<FrameHeader> parse_frame_header(string_view strv) {
+  if (strv.size() < FRAME_HEADER_SIZE) {
+    return nullopt;
+  }
+  const auto *p = reinterpret_cast<const uint8_t *>(strv.data());
+  return FrameHeader{
+      uint32_t(p[0]) << 16 | uint32_t(p[1]) << 8 | p[2],
+      static_cast<FrameType>(p[3]),
+      p[4],
+      (uint32_t(p[5]) << 24 | uint32_t(p[6]) << 16 | uint32_t(p[7]) << 8 | p[8]) & 0x7fffffff,
+  };
+}
+
+void write_frame_header(string &out, uint32_t length, FrameType type, uint8_t flags, uint32_t stream_id) {
+  char header[FRAME_HEADER_SIZE] = {
+      static_cast<char>(length >> 16),    static_cast<char>(length >> 8),     static_cast<char>(length),
+      static_cast<char>(type),            static_cast<char>(flags),           static_cast<char>(stream_id >> 24),
+      static_cast<char>(stream_id >> 16), static_cast<char>(stream_id >> 8), static_cast<char>(stream_id),
+  };
+  out.append(header, FRAME_HEADER_SIZE);
+}
+
+} // namespace h2
+
+namespace {
+
+using namespace h2;
+
+constexpr int64_t MAX_WINDOW = 0x7fffffff;
+// Header blocks (HEADERS plus CONTINUATION) larger than this end the connection
+constexpr size_t MAX_HEADER_BLOCK = 64 * 1024;
+// Request bodies buffered across one connection before streams stop getting receive credit
+constexpr size_t MAX_BUFFERED_BODIES = 1024 * 1024;
+constexpr uint16_t SETTINGS_ENABLE_PUSH = 0x2;
+constexpr uint16_t SETTINGS_MAX_CONCURRENT_STREAMS = 0x3;
+constexpr uint16_t SETTINGS_INITIAL_WINDOW_SIZE = 0x4;
+constexpr uint16_t SETTINGS_MAX_FRAME_SIZE = 0x5;
+constexpr uint16_t SETTINGS_MAX_HEADER_LIST_SIZE = 0x6;
+
+uint32_t read_u32(string_view bytes) {
+  const auto *p = reinterpret_cast<const uint8_t *>(bytes.data());
+  return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3];
+}
+
+void append_u32(string &out, uint32_t value) {
+  out += static_cast<char>(value >> 24);
+  out += static_cast<char>(value >> 16);
+  out += static_cast<char>(value >> 8);
+  out += static_cast<char>(value);
+}
+
+void append_setting(string &out, uint16_t id, uint32_t value) {
+  out += static_cast<char>(id >> 8);
+  out += static_cast<char>(id);
+  append_u32(out, value);
+}
+
+// HTTP2-Settings is base64url without padding
+optional<string> decode_base64url(string_view in) {
+  while (!in.empty() && in.back() == '=') {
+    in.remove_suffix(1);
+  }
+  string out;
+  uint32_t bits = 0;
+  int count = 0;
+  for (char c : in) {
+    int value;
+    if (c >= 'A' && c <= 'Z') {
+      value = c - 'A';
+    } else if (c >= 'a' && c <= 'z') {
+      value = c - 'a' + 26;
+    } else if (c >= '0' && c <= '9') {
+      value = c - '0' + 52;
+    } else if (c == '-' || c == '+') {
+      value = 62;
+    } else if (c == '_' || c == '/') {
+      value = 63;
+    } else {
+      return nullopt;
+    }
+    bits = bits << 6 | value;
+    count += 6;
+    if (count >= 8) {
+      count -= 8;
+      out += static_cast<char>(bits >> count);
+    }
+  }
+  return out;
+}
+
+// HTTP/2 field names are lowercase; the router and handlers look headers up as `User-Agent`
+string canonical_name(string_view name) {
+  string out(name);
+  bool upper = true;
+  for (char &c : out) {
+    if (upper) {
+      c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
+    }
+    upper = c == '-';
+  }
+  return out;
+}
+
+bool connection_specific(string_view name) {
+  return name == "connection" || name == "keep-alive" || name == "proxy-connection" || name == "transfer-encoding" ||
+         name == "upgrade";
+}
+
+// Fills `request` from a decoded request header block; false if it is malformed (RFC 9113 8.3.1)
+bool build_request(vector<hpack::HeaderField> &fields, Request &request) {
+  optional<Method> method;
+  string path;
+  bool scheme = false;
+  bool regular = false;
+  for (auto &[name, value] : fields) {
+    if (name.starts_with(':')) {
+      if (regular) {
+        return false;
+      }
+      if (name == ":method") {
+        method = parse_method(value);
+      } else if (name == ":path") {
+        path = std::move(value);
+      } else if (name == ":scheme") {
+        scheme = true;
+      } else if (name == ":authority") {
+        request.headers.set("Host", value);
+      } else {
+        return false;
+      }
+      continue;
+    }
+    regular = true;
+    if (any_of(name.begin(), name.end(), [](char c) { return isupper(static_cast<unsigned char>(c)); }) ||
+        connection_specific(name) || (name == "te" && value != "trailers")) {
+      return false;
+    }
+    auto &slot = request.headers.data[canonical_name(name)];
+    if (!slot.empty()) {
+      slot += name == "cookie" ? "; " : ", ";
+    }
+    slot += value;
+  }
+  if (!method || !scheme || !path.starts_with('/')) {
+    return false;
+  }
+  request.requestLine = {*method, std::move(path), "HTTP/2"};
+  return true;
+}
+
+struct Stream {
+  Request request{};
+  bool headers_received = false;
+  bool remote_closed = false; // END_STREAM received
+  bool refused = false;       // over the concurrency limit; reset once its headers are decoded
+  bool shed = false;          // refused by admission control; answered 503 once its headers are decoded
+  bool head_checked = false;  // passed the route's checks when its headers arrived
+  net::RequestContext context{}; // for the access log, as of its first HEADERS frame
+  size_t max_body_size = config::MAX_BODY_SIZE; // the route's, once matched
+  int64_t send_window = DEFAULT_WINDOW;
+  int64_t receive_window = DEFAULT_WINDOW;
+  // The response body, sent in DATA frames as flow control allows
+  variant<monostate, shared_ptr<const string>, string_view, net::FileSegment> body;
+  size_t body_size = 0;
+  size_t sent = 0;
+};
+
+class Http2Session : public net::Session {
+public:
+  Http2Session(Serve serve, StreamLog log, bool awaiting_preface)
+      : serve(std::move(serve)), log(std::move(log)), awaiting_preface(awaiting_preface) {}
+
+  // The request that asked for the upgrade, answered on stream 1
+  optional<Request> upgraded;
+
+  optional<ErrorCode> apply_settings(string_view payload) {
+    for (; payload.size() >= 6; payload.remove_prefix(6)) {
+      uint16_t id = uint16_t(uint8_t(payload[0])) << 8 | uint8_t(payload[1]);
+      uint32_t value = read_u32(payload.substr(2));
+      if (id == SETTINGS_ENABLE_PUSH && value > 1) {
+        return ErrorCode::ProtocolError;
+      }
+      if (id == SETTINGS_INITIAL_WINDOW_SIZE) {
+        if (value > MAX_WINDOW) {
+          return ErrorCode::FlowControlError;
+        }
+        // Applies to every open stream, possibly driving windows negative
+        int64_t delta = int64_t(value) - peer_initial_window;
+        for (auto &[stream_id, stream] : streams) {
+          stream.send_window += delta;
+          if (stream.send_window > MAX_WINDOW) {
+            return ErrorCode::FlowControlError;
+          }
+        }
+        peer_initial_window = value;
+      }
+      if (id == SETTINGS_MAX_FRAME_SIZE) {
+        if (value < DEFAULT_MAX_FRAME_SIZE || value > 0xffffff) {
+          return ErrorCode::ProtocolError;
+        }
+        peer_max_frame_size = value;
+      }
+      // The header table size only bounds an encoder's dynamic table, and ours uses none
+    }
+    return nullopt;
+  }
+
+  void on_open(net::Output &output, net::ConnectionHandle handle) override {
+    this->handle = handle;
+    string settings;
+    append_setting(settings, SETTINGS_MAX_CONCURRENT_STREAMS, MAX_CONCURRENT_STREAMS);
+    append_setting(settings, SETTINGS_MAX_HEADER_LIST_SIZE, MAX_HEADER_LIST_SIZE);
+    frame(output, FrameType::Settings, 0, 0, settings);
+    if (upgraded) {
+      last_stream_id = 1;
+      auto &stream = streams[1];
+      stream.request = std::move(*upgraded);
+      stream.headers_received = true;
+      stream.remote_closed = true;
+      stream.send_window = peer_initial_window;
+      stream.context = net::request_context(handle);
+      upgraded.reset();
+      respond(1, stream, output);
+      pump(output);
+    }
+  }
+
+  net::HandlerResult on_input(span<char> input, net::Output &output) override {
+    string_view in(input.data(), input.size());
+    size_t pos = 0;
+    if (awaiting_preface) {
+      size_t n = min(in.size(), HTTP2_PREFACE.size());
+      if (in.substr(0, n) != HTTP2_PREFACE.substr(0, n)) {
+        return {input.size(), true};
+      }
+      if (n < HTTP2_PREFACE.size()) {
+        return {0, false};
+      }
+      pos = n;
+      awaiting_preface = false;
+    }
+    uint32_t credit = 0; // connection window to hand back for DATA read in this call
+    while (!closing) {
+      auto header = parse_frame_header(in.substr(pos));
+      if (!header) {
+        break;
+      }
+      if (header->length > DEFAULT_MAX_FRAME_SIZE) {
+        connection_error(output, ErrorCode::FrameSizeError);
+        break;
+      }
+      if (in.size() - pos - FRAME_HEADER_SIZE < header->length) {
+        break;
+      }
+      string_view payload = in.substr(pos + FRAME_HEADER_SIZE, header->length);
+      pos += FRAME_HEADER_SIZE + header->length;
+      if (header->type == FrameType::Data) {
+        if (header->length > receive_window) {
+          connection_error(output, ErrorCode::FlowControlError);
+          break;
+        }
+        receive_window -= header->length;
+        credit += header->length;
+      }
+      handle_frame(*header, payload, output);
+    }
+    if (closing) {
+      return {input.size(), true};
+    }
+    // Every byte read was either dropped or buffered under its stream's window, so the connection
+    // window is handed back at once
+    if (credit > 0) {
+      window_update(output, 0, credit);
+      receive_window += credit;
+    }
+    replenish(output);
+    pump(output);
+    // A peer that sent GOAWAY gets its open streams answered, then the connection ends
+    if (goaway_received && streams.empty()) {
+      return {input.size(), true};
+    }
+    return {pos, false};
+  }
+
+private:
+  void frame(net::Output &output, FrameType type, uint8_t flags, uint32_t stream_id, string_view payload) {
+    size_t mark = output.buffer.size();
+    write_frame_header(output.buffer, payload.size(), type, flags, stream_id);
+    output.buffer += payload;
+    output.commit(mark);
+  }
+
+  void window_update(net::Output &output, uint32_t stream_id, uint32_t increment) {
+    string payload;
+    append_u32(payload, increment);
+    frame(output, FrameType::WindowUpdate, 0, stream_id, payload);
+  }
+
+  void reset_stream(net::Output &output, uint32_t stream_id, ErrorCode code) {
+    string payload;
+    append_u32(payload, static_cast<uint32_t>(code));
+    frame(output, FrameType::RstStream, 0, stream_id, payload);
+    streams.erase(stream_id);
+  }
+
+  // Answers with a bodiless error status. A client still sending is told to stop with RST_STREAM
+  // NO_ERROR, which keeps the response (RFC 9113 8.1).
+  void reject_stream(net::Output &output, uint32_t stream_id, Status status, bool remote_closed) {
+    Response response{};
+    response.set_status(status);
+    reject_stream(output, stream_id, response, remote_closed);
+  }
+
+  void reject_stream(net::Output &output, uint32_t stream_id, const Response &response, bool remote_closed) {
+    write_headers(output, stream_id, response, 0, true);
+    log_stream(streams.at(stream_id), response.responseLine.status.code, 0);
+    if (remote_closed) {
+      streams.erase(stream_id);
+    } else {
+      reset_stream(output, stream_id, ErrorCode::NoError);
+    }
+  }
+
+  // Shed streams were already reported by admission control
+  void log_stream(const Stream &stream, uint16_t status, size_t bytes) {
+    if (log && !stream.shed) {
+      log(stream.context, stream.headers_received ? &stream.request : nullptr, status, bytes);
+    }
+  }
+
+  void connection_error(net::Output &output, ErrorCode code) {
+    string payload;
+    append_u32(payload, last_stream_id);
+    append_u32(payload, static_cast<uint32_t>(code));
+    frame(output, FrameType::Goaway, 0, 0, payload);
+    closing = true;
+  }
+
+  // DATA and HEADERS may carry padding after a length byte
+  optional<string_view> strip_padding(const FrameHeader &header, string_view payload) {
+    if (!(header.flags & flag::PADDED)) {
+      return payload;
+    }
+    if (payload.empty() || uint8_t(payload[0]) >= payload.size()) {
+      return nullopt;
+    }
+    return payload.substr(1, payload.size() - 1 - uint8_t(payload[0]));
+  }
+
+  void handle_frame(const FrameHeader &header, string_view payload, net::Output &output) {
+    // A header block must arrive without other frames in between
+    if (continuation_stream != 0 &&
+        (header.type != FrameType::Continuation || header.stream_id != continuation_stream)) {
+      connection_error(output, ErrorCode::ProtocolError);
+      return;
+    }
+    switch (header.type) {
+    case FrameType::Data:
+      on_data(header, payload, output);
+      break;
+    case FrameType::Headers:
+      on_headers(header, payload, output);
+      break;
+    case FrameType::Continuation:
+      if (continuation_stream == 0) {
+        connection_error(output, ErrorCode::ProtocolError);
+        return;
+      }
+      on_header_fragment(header.flags, payload, output);
+      break;
+    case FrameType::Priority:
+      if (header.stream_id == 0) {
+        connection_error(output, ErrorCode::ProtocolError);
+      }
+      break;
+    case FrameType::RstStream:
+      if (header.stream_id == 0 || header.length != 4) {
+        connection_error(output, header.stream_id == 0 ? ErrorCode::ProtocolError : ErrorCode::FrameSizeError);
+        return;
+      }
+      streams.erase(header.stream_id);
+      break;
+    case FrameType::Settings:
+      on_settings(header, payload, output);
+      break;
+    case FrameType::Ping:
+      if (header.stream_id != 0 || header.length != 8) {
+        connection_error(output, header.stream_id != 0 ? ErrorCode::ProtocolError : ErrorCode::FrameSizeError);
+        return;
+      }
+      if (!(header.flags & flag::ACK)) {
+        frame(output, FrameType::Ping, flag::ACK, 0, payload);
+      }
+      break;
+    case FrameType::Goaway:
+      if (header.stream_id != 0) {
+        connection_error(output, ErrorCode::ProtocolError);
+        return;
+      }
+      goaway_received = true;
+      break;
+    case FrameType::WindowUpdate:
+      on_window_update(header, payload, output);
+      break;
+    case FrameType::PushPromise:
+      connection_error(output, ErrorCode::ProtocolError); // clients never push
+      break;
+    default:
+      break; // unknown frame types are ignored
+    }
+  }
+
+  void on_settings(const FrameHeader &header, string_view payload, net::Output &output) {
+    if (header.stream_id != 0) {
+      connection_error(output, ErrorCode::ProtocolError);
+      return;
+    }
+    if (header.flags & flag::ACK) {
+      if (header.length != 0) {
+        connection_error(output, ErrorCode::FrameSizeError);
+      }
+      return;
+    }
+    if (header.length % 6 != 0) {
+      connection_error(output, ErrorCode::FrameSizeError);
+      return;
+    }
+    if (auto error = apply_settings(payload)) {
+      connection_error(output, *error);
+      return;
+    }
+    frame(output, FrameType::Settings, flag::ACK, 0, {});
+  }
+
+  void on_window_update(const FrameHeader &header, string_view payload, net::Output &output) {
+    if (header.length != 4) {
+      connection_error(output, ErrorCode::FrameSizeError);
+      return;
+    }
+    uint32_t increment = read_u32(payload) & 0x7fffffff;
+    if (header.stream_id == 0) {
+      connection_window += increment;
+      if (increment == 0 || connection_window > MAX_WINDOW) {
+        connection_error(output, increment == 0 ? ErrorCode::ProtocolError : ErrorCode::FlowControlError);
+      }
+      return;
+    }
+    auto it = streams.find(header.stream_id);
+    if (it == streams.end()) {
+      return; // already answered and closed
+    }
+    it->second.send_window += increment;
+    if (increment == 0 || it->second.send_window > MAX_WINDOW) {
+      reset_stream(output, header.stream_id, increment == 0 ? ErrorCode::ProtocolError : ErrorCode::FlowControlError);
+    }
+  }
+
+  void on_headers(const FrameHeader &header, string_view payload, net::Output &output) {
+    auto fragment = strip_padding(header, payload);
+    if (header.stream_id == 0 || !fragment || ((header.flags & flag::PRIORITY) && fragment->size() < 5)) {
+      connection_error(output, ErrorCode::ProtocolError);
+      return;
+    }
+    if (header.flags & flag::PRIORITY) {
+      fragment->remove_prefix(5);
+    }
+    auto it = streams.find(header.stream_id);
+    if (it == streams.end()) {
+      // A new stream: client-initiated ids are odd and increase
+      if (header.stream_id % 2 == 0 || header.stream_id <= last_stream_id) {
+        connection_error(output, ErrorCode::ProtocolError);
+        return;
+      }
+      last_stream_id = header.stream_id;
+      bool refused = streams.size() >= MAX_CONCURRENT_STREAMS || goaway_received;
+      // Each stream is a request to admission control, like each request on an HTTP/1.1 connection
+      bool shed = !refused && !net::admit(handle, streams.size());
+      it = streams.emplace(header.stream_id, Stream{}).first;
+      it->second.send_window = peer_initial_window;
+      it->second.context = net::request_context(handle);
+      it->second.refused = refused;
+      it->second.shed = shed;
+    } else if (it->second.remote_closed) {
+      connection_error(output, ErrorCode::StreamClosed);
+      return;
+    }
+    header_stream = header.stream_id;
+    header_end_stream = header.flags & flag::END_STREAM;
+    header_block.assign(*fragment);
+    continuation_stream = header.stream_id;
+    on_header_fragment(header.flags, {}, output);
+  }
+
+  void on_header_fragment(uint8_t flags, string_view fragment, net::Output &output) {
+    header_block += fragment;
+    if (header_block.size() > MAX_HEADER_BLOCK) {
+      connection_error(output, ErrorCode::EnhanceYourCalm);
+      return;
+    }
+    if (!(flags & flag::END_HEADERS)) {
+      return;
+    }
+    continuation_stream = 0;
+    // Decoded even for refused streams: the dynamic table must stay in step with the client's
+    auto fields = decoder.decode(header_block);
+    header_block.clear();
+    // An oversized list still updated the table, so only its stream fails
+    if (!fields && fields.error() != hpack::Error::HeaderListTooLarge) {
+      connection_error(output, ErrorCode::CompressionError);
+      return;
+    }
+    auto it = streams.find(header_stream);
+    if (it == streams.end()) {
+      return;
+    }
+    auto &stream = it->second;
+    if (stream.refused) {
+      reset_stream(output, header_stream, ErrorCode::RefusedStream);
+      return;
+    }
+    if (stream.shed) {
+      // The HTTP/1.1 overload response, in this connection's framing
+      Response response{};
+      response.set_status(status::SERVICE_UNAVAILABLE);
+      response.headers.set("Retry-After", "1");
+      reject_stream(output, header_stream, response, header_end_stream);
+      return;
+    }
+    if (!fields) {
+      reject_stream(output, header_stream, status::REQUEST_HEADER_FIELDS_TOO_LARGE, header_end_stream);
+      return;
+    }
+    if (!stream.headers_received) {
+      stream.headers_received = true;
+      if (!build_request(*fields, stream.request)) {
+        reset_stream(output, header_stream, ErrorCode::ProtocolError);
+        return;
+      }
+      // The route's limits apply before any of the body is buffered; without a route, dispatch answers
+      if (auto route = match_route(stream.request)) {
+        if (auto rejected = check_request_head(*route, stream.request)) {
+          reject_stream(output, header_stream, *rejected, header_end_stream);
+          return;
+        }
+        stream.head_checked = true;
+        stream.max_body_size = route->options.max_body_size;
+      }
+    }
+    // A second block is trailers, which carry nothing the handlers use
+    if (header_end_stream) {
+      stream.remote_closed = true;
+      respond(header_stream, stream, output);
+    }
+  }
+
+  void on_data(const FrameHeader &header, string_view payload, net::Output &output) {
+    auto data = strip_padding(header, payload);
+    if (header.stream_id == 0 || !data) {
+      connection_error(output, ErrorCode::ProtocolError);
+      return;
+    }
+    auto it = streams.find(header.stream_id);
+    if (it == streams.end() || it->second.remote_closed || !it->second.headers_received) {
+      if (header.stream_id > last_stream_id) {
+        connection_error(output, ErrorCode::ProtocolError);
+      }
+      return; // a stream we already answered or reset; its connection credit was still returned
+    }
+    auto &stream = it->second;
+    if (header.length > stream.receive_window) {
+      reset_stream(output, header.stream_id, ErrorCode::FlowControlError);
+      return;
+    }
+    stream.receive_window -= header.length;
+    if (stream.request.body.size() + data->size() > stream.max_body_size) {
+      reject_stream(output, header.stream_id, status::CONTENT_TOO_LARGE, false);
+      return;
+    }
+    stream.request.body += *data;
+    if (header.flags & flag::END_STREAM) {
+      stream.remote_closed = true;
+      respond(header.stream_id, stream, output);
+    }
+  }
+
+  // Tops up the receive window of each stream still sending its body, never past what its route
+  // would still accept plus one byte, so an oversized body reaches its 413 instead of stalling.
+  // Past MAX_BUFFERED_BODIES on the connection only the oldest such stream gets credit; once it is
+  // served its body is released and the others resume.
+  void replenish(net::Output &output) {
+    size_t buffered = 0;
+    for (const auto &[stream_id, stream] : streams) {
+      buffered += stream.request.body.size();
+    }
+    bool oldest = true;
+    for (auto &[stream_id, stream] : streams) {
+      if (!stream.headers_received || stream.remote_closed) {
+        continue;
+      }
+      int64_t target = min<int64_t>(DEFAULT_WINDOW, stream.max_body_size + 1 - stream.request.body.size());
+      if (!oldest && buffered >= MAX_BUFFERED_BODIES) {
+        target = 0;
+      }
+      oldest = false;
+      if (target > stream.receive_window) {
+        window_update(output, stream_id, target - stream.receive_window);
+        stream.receive_window = target;
+      }
+    }
+  }
+
+  // Runs the request through the handlers and queues the response head; the body follows in pump()
+  void respond(uint32_t stream_id, Stream &stream, net::Output &output) {
+    Response response{};
+    Exchange exchange{stream.request, response};
+    exchange.head_checked = stream.head_checked;
+    serve(exchange);
+    string().swap(stream.request.body); // no longer counts against MAX_BUFFERED_BODIES
+    // The session that would carry these needs the whole connection; the client retries over HTTP/1.1
+    if (exchange.upgrade || response.streaming ||
+        response.responseLine.status.code == status::SWITCHING_PROTOCOLS.code) {
+      reset_stream(output, stream_id, ErrorCode::Http11Required);
+      return;
+    }
+    if (response.file) {
+      stream.body_size = response.file->length;
+      stream.body = std::move(*response.file);
+    } else if (!response.static_body.empty()) {
+      stream.body_size = response.static_body.size();
+      stream.body = response.static_body;
+    } else if (!response.body.empty()) {
+      stream.body_size = response.body.size();
+      stream.body = make_shared<const string>(std::move(response.body));
+    }
+    write_headers(output, stream_id, response, stream.body_size, stream.body_size == 0);
+    log_stream(stream, response.responseLine.status.code, stream.body_size);
+    if (stream.body_size == 0) {
+      streams.erase(stream_id);
+    }
+  }
+
+  void write_headers(net::Output &output, uint32_t stream_id, const Response &response, size_t body_size,
+                     bool end_stream) {
+    auto code = response.responseLine.status.code;
+    string block;
+    hpack::encode_field(block, ":status", to_string(code));
+    bool has_length = false;
+    for (const auto &[key, value] : response.headers.data) {
+      string name = key;
+      transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return tolower(c); });
+      if (connection_specific(name)) {
+        continue;
+      }
+      has_length |= name == "content-length";
+      hpack::encode_field(block, name, value);
+    }
+    if (code >= 200 && code != status::NOT_MODIFIED.code && !has_length) {
+      hpack::encode_field(block, "content-length", to_string(body_size));
+    }
+    hpack::encode_field(block, "date", format_http_date(time(nullptr)));
+    hpack::encode_field(block, "server", "http-server-cpp");
+
+    // Split into HEADERS and CONTINUATION frames of at most the peer's frame size
+    string_view rest = block;
+    FrameType type = FrameType::Headers;
+    do {
+      string_view piece = rest.substr(0, peer_max_frame_size);
+      rest.remove_prefix(piece.size());
+      uint8_t flags = rest.empty() ? flag::END_HEADERS : 0;
+      if (type == FrameType::Headers && end_stream) {
+        flags |= flag::END_STREAM;
+      }
+      frame(output, type, flags, stream_id, piece);
+      type = FrameType::Continuation;
+    } while (!rest.empty());
+  }
+
+  // Queues DATA frames round-robin, one frame per stream per round, within the connection's and each
+  // stream's send window. A stream that exhausted its window never holds up the others.
+  void pump(net::Output &output) {
+    bool progress = true;
+    while (progress && connection_window > 0) {
+      progress = false;
+      for (auto it = streams.begin(); it != streams.end() && connection_window > 0;) {
+        auto &[stream_id, stream] = *it;
+        if (!stream.remote_closed || stream.body_size == 0 || stream.send_window <= 0) {
+          ++it;
+          continue;
+        }
+        size_t n = min({stream.body_size - stream.sent, size_t(stream.send_window), size_t(connection_window),
+                        size_t(peer_max_frame_size)});
+        bool last = stream.sent + n == stream.body_size;
+        size_t mark = output.buffer.size();
+        write_frame_header(output.buffer, n, FrameType::Data, last ? flag::END_STREAM : 0, stream_id);
+        output.commit(mark);
+        if (const auto *bytes = get_if<shared_ptr<const string>>(&stream.body)) {
+          output.append(net::SharedSlice{*bytes, stream.sent, n});
+        } else if (const auto *view = get_if<string_view>(&stream.body)) {
+          output.append(net::StaticSegment{view->substr(stream.sent, n)});
+        } else if (const auto *file = get_if<net::FileSegment>(&stream.body)) {
+          output.append(net::FileSegment{file->file, file->offset + off_t(stream.sent), n});
+        }
+        stream.sent += n;
+        stream.send_window -= n;
+        connection_window -= n;
+        progress = true;
+        it = last ? streams.erase(it) : next(it);
+      }
+    }
+  }
+
+  Serve serve;
+  StreamLog log;
+  bool awaiting_preface;
+  net::ConnectionHandle handle; // for admission control and the request context of new streams
+  bool closing = false;
+  bool goaway_received = false;
+  hpack::Decoder decoder{4096, MAX_HEADER_LIST_SIZE};
+  map<uint32_t, Stream> streams; // open, or answered with body still to send
+  uint32_t last_stream_id = 0;
+  int64_t connection_window = DEFAULT_WINDOW;
+  int64_t receive_window = DEFAULT_WINDOW; // what the peer may still send on the connection
+  int64_t peer_initial_window = DEFAULT_WINDOW;
+  uint32_t peer_max_frame_size = DEFAULT_MAX_FRAME_SIZE;
+  // The header block being received
+  uint32_t continuation_stream = 0; // set while CONTINUATION frames are expected
+  uint32_t header_stream = 0;
+  bool header_end_stream = false;
+  string header_block;
+};
+
+} // namespace
+
+unique_ptr<net::Session> http2_session(Serve serve, StreamLog log) {
+  return make_unique<Http2Session>(std::move(serve), std::move(log), false);
+}
+
+unique_ptr<net::Session> http2_upgrade(const Request &request, string_view settings, Serve serve, StreamLog log) {
+  auto payload = decode_base64url(settings);
+  if (!payload || payload->size() % 6 != 0) {
+    return nullptr;
+  }
+  auto session = make_unique<Http2Session>(std::move(serve), std::move(log), true);
+  if (session->apply_settings(*payload)) {
+    return nullptr;
+  }
+  session->upgraded = request;
+  auto &headers = session->upgraded->headers.data;
+  headers.erase("Connection");
+  headers.erase("Upgrade");
+  headers.erase("HTTP2-Settings");
+  return session;
+}
+
+} // namespace http
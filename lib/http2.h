@@ -0,0 +1,126 @@
+#pragma once
+
+#include "hpack.h"
+#include "middleware.h"
+#include "parse.h"
+#include "server.h"
+#include "session.h"
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <memory>
+#include <string_view>
+
+// Cleartext HTTP/2 (h2c, RFC 9113): binary frames, HPACK and flow control over one connection, with
+// each stream's request run through the usual router and handlers
+namespace http {
+
+// What a client with prior knowledge sends before its first frame
+constexpr std::string_view HTTP2_PREFACE = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+namespace h2 {
+
+enum class FrameType : uint8_t {
+  Data = 0x0,
+  Headers = 0x1,
+  Priority = 0x2,
+  RstStream = 0x3,
+  Settings = 0x4,
+  PushPromise = 0x5,
+  Ping = 0x6,
+  Goaway = 0x7,
+  WindowUpdate = 0x8,
+  Continuation = 0x9,
+};
+
+namespace flag {
+constexpr uint8_t END_STREAM = 0x1;
+constexpr uint8_t ACK = 0x1;
+constexpr uint8_t END_HEADERS = 0x4;
+constexpr uint8_t PADDED = 0x8;
+constexpr uint8_t PRIORITY = 0x20;
+} // namespace flag
+
+enum class ErrorCode : uint32_t {
+  NoError = 0x0,
+  ProtocolError = 0x1,
+  InternalError = 0x2,
+  FlowControlError = 0x3,
+  StreamClosed = 0x5,
+  FrameSizeError = 0x6,
+  RefusedStream = 0x7,
+  CompressionError = 0x9,
+  EnhanceYourCalm = 0xb,
+  Http11Required = 0xd,
+};
+
+constexpr size_t FRAME_HEADER_SIZE = 9;
+constexpr uint32_t DEFAULT_WINDOW = 65535;
+constexpr uint32_t DEFAULT_MAX_FRAME_SIZE = 16384;
+constexpr uint32_t MAX_CONCURRENT_STREAMS = 100;
+// Decoded size of a request's header fields (name + value + 32 each); larger requests get a 431
+constexpr uint32_t MAX_HEADER_LIST_SIZE = 16 * 1024;
+
+struct FrameHeader {
+  uint32_t length;
+  FrameType type;
+  uint8_t flags;
+  uint32_t stream_id;
+};
+
+// The 9-byte frame header at the start of `strv`, or nullopt if fewer bytes arrived
+std::optional<FrameHeader> parse_frame_header(std::string_view strv);
+void write_frame_header(std::string &out, uint32_t length, FrameType type, uint8_t flags, uint32_t stream_id);
+
+} // namespace h2
+
+// Serves one stream's request; the chain must end in `dispatch`. Its output is framed for HTTP/2, so
+// it must not include middleware that serializes HTTP/1.1 bytes (Cache) or upgrades. Routes that
+// switch protocols or stream server-sent events get RST_STREAM HTTP_1_1_REQUIRED instead.
+using Serve = std::function<void(Exchange &)>;
+
+// Told about each stream answered with a status, once its response is queued: the request (null if
+// its headers were too large to decode) and the size of the response body. Requests shed by
+// admission control are reported to Options::on_reject instead.
+using StreamLog = std::function<void(const net::RequestContext &context, const Request *request, uint16_t status,
+                                     size_t bytes)>;
+
+// The session for a connection whose client sent HTTP2_PREFACE, which the caller consumed
+std::unique_ptr<net::Session> http2_session(Serve serve, StreamLog log = {});
+
+// The session after `101 Switching Protocols` on `Upgrade: h2c`. `request` becomes stream 1 and
+// `settings` is the client's base64url HTTP2-Settings header; nullptr if that does not decode.
+std::unique_ptr<net::Session> http2_upgrade(const Request &request, std::string_view settings, Serve serve,
+                                            StreamLog log = {});
+
+// Switches bodiless requests carrying `Upgrade: h2c`, `Connection: Upgrade, HTTP2-Settings` and an
+// HTTP2-Settings header to HTTP/2 (RFC 7540 3.2); anything else continues as HTTP/1.1, which the
+// client must accept. Place before Cache.
+struct H2cUpgrade {
+  Serve serve;
+  StreamLog log;
+
+  template <typename Next> void operator()(Exchange &exchange, Next &&next) const {
+    const auto &headers = exchange.request.headers.data;
+    auto upgrade = headers.find("Upgrade");
+    auto connection = headers.find("Connection");
+    auto settings = headers.find("HTTP2-Settings");
+    if (upgrade == headers.end() || !has_token(upgrade->second, "h2c") || connection == headers.end() ||
+        !has_token(connection->second, "Upgrade") || !has_token(connection->second, "HTTP2-Settings") ||
+        settings == headers.end() || !exchange.request.body.empty()) {
+      next(exchange);
+      return;
+    }
+    auto session = http2_upgrade(exchange.request, settings->second, serve, log);
+    if (!session) {
+      next(exchange);
+      return;
+    }
+    exchange.response.set_status(status::SWITCHING_PROTOCOLS);
+    exchange.response.headers.set("Connection", "Upgrade");
+    exchange.response.headers.set("Upgrade", "h2c");
+    exchange.upgrade = std::move(session);
+  }
+};
+
+} // namespace http
@@ -0,0 +1,53 @@
+#include "middleware.h"
+
+namespace http {
+
+DynamicPipeline &DynamicPipeline::use(Middleware middleware) {
+  stages.push_back(std::move(middleware));
+  return *this;
+}
+
+void DynamicPipeline::run(size_t index, Exchange &exchange, const Next &handler) {
+  if (index == stages.size()) {
+    handler(exchange);
+    return;
+  }
+  stages[index](exchange, [this, index, &handler](Exchange &e) { run(index + 1, e, handler); });
+}
+
+void dispatch(Exchange &exchange) {
+  exchange.route = match_route(exchange.request);
+  if (!exchange.route) {
+    return;
+  }
+  // Messages that arrived whole were never checked while awaiting their body
+  if (!exchange.head_checked) {
+    if (auto status = check_request_head(*exchange.route, exchange.request)) {
+      exchange.response.set_status(*status);
+      return;
+    }
+  }
+  exchange.route->handler(exchange.request, exchange.response);
+  // A 101 switches protocols and a streamed 200 keeps writing; neither applies to HEAD
+  const auto &response = exchange.response;
+  if (exchange.route->options.upgrade && exchange.request.requestLine.method != Method::Head &&
+      (response.responseLine.status.code == status::SWITCHING_PROTOCOLS.code || response.streaming)) {
+    exchange.upgrade = exchange.route->options.upgrade(exchange.request);
+  }
+}
+
+std::string_view negotiate_encoding(const Request &request) {
+  auto ae = request.headers.data.find("Accept-Encoding");
+  return ae != request.headers.data.end() && ae->second.find("gzip") != std::string::npos ? "gzip" : "";
+}
+
+void Cache::store(Exchange &exchange, std::string_view encoding) const {
+  const auto &route = exchange.route;
+  const auto &response = exchange.response;
+  if (!route || !route->options.cache || response.file || response.responseLine.status.code != status::OK.code) {
+    return;
+  }
+  exchange.serialized = cache.store(exchange.request, encoding, *route->options.cache, response.to_cached());
+}
+
+} // namespace http
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "cache.h"
+#include "response.h"
+#include "route.h"
+#include <functional>
+#include <optional>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace http {
+
+// Per-request state shared by the middleware chain
+struct Exchange {
+  Request &request;
+  Response &response;
+  std::shared_ptr<const Route> route; // set by dispatch
+  bool close_connection = false;  // reported back to the server once the response is queued
+  ResponseCache::Bytes serialized; // when set, sent instead of `response` with write_cached
+  std::unique_ptr<net::Session> upgrade; // set by dispatch when the route switched protocols
+  bool head_checked = false; // the route's limits and precondition already passed while the body was read
+};
+
+// A middleware is any object callable as `m(exchange, next)`; it runs `next(exchange)` to continue the
+// chain, or returns without calling it to answer on its own. The chain is built from nested lambdas, so
+// the compiler sees straight through it and inlines every stage.
+template <typename... Middleware> class Pipeline {
+public:
+  explicit Pipeline(Middleware... middleware) : stages(std::move(middleware)...) {}
+
+  template <typename Handler> void operator()(Exchange &exchange, Handler &&handler) {
+    run<0>(exchange, handler);
+  }
+
+private:
+  template <size_t I, typename Handler> void run(Exchange &exchange, Handler &handler) {
+    if constexpr (I == sizeof...(Middleware)) {
+      handler(exchange);
+    } else {
+      std::get<I>(stages)(exchange, [this, &handler](Exchange &e) { run<I + 1>(e, handler); });
+    }
+  }
+
+  std::tuple<Middleware...> stages;
+};
+
+// Composed at runtime, at the cost of one indirect call per stage. Usable as a stage of a Pipeline.
+class DynamicPipeline {
+public:
+  using Next = std::function<void(Exchange &)>;
+  using Middleware = std::function<void(Exchange &, const Next &)>;
+
+  DynamicPipeline &use(Middleware middleware);
+
+  template <typename Handler> void operator()(Exchange &exchange, Handler &&handler) {
+    run(0, exchange, Next(std::ref(handler)));
+  }
+
+private:
+  void run(size_t index, Exchange &exchange, const Next &handler);
+
+  std::vector<Middleware> stages;
+};
+
+// Resolves the route, applies its limits (see check_request_head) unless already done, and runs its
+// handler, creating the route's session on a 101 or a streamed response; the usual end of a chain
+void dispatch(Exchange &exchange);
+
+// "gzip" when the client accepts it, otherwise "" (identity)
+std::string_view negotiate_encoding(const Request &request);
+
+// Honors `Connection: close` from the client and echoes it on the response
+struct KeepAlive {
+  template <typename Next> void operator()(Exchange &exchange, Next &&next) const {
+    auto conn = exchange.request.headers.data.find("Connection");
+    exchange.close_connection = conn != exchange.request.headers.data.end() && conn->second == "close";
+    next(exchange);
+    if (exchange.close_connection) {
+      exchange.response.headers.set("Connection", "close");
+    }
+  }
+};
+
+// Serves and fills the response cache for routes with a CachePolicy. Cached bytes never carry
+// `Connection: close`, so only keep-alive requests use them; place inside KeepAlive.
+struct Cache {
+  ResponseCache &cache;
+
+  template <typename Next> void operator()(Exchange &exchange, Next &&next) const {
+    if (exchange.close_connection) {
+      next(exchange);
+      return;
+    }
+    auto encoding = negotiate_encoding(exchange.request);
+    if (auto hit = cache.lookup(exchange.request, encoding)) {
+      exchange.serialized = std::move(hit);
+      return;
+    }
+    next(exchange);
+    store(exchange, encoding);
+  }
+
+private:
+  void store(Exchange &exchange, std::string_view encoding) const;
+};
+
+// HEAD runs the GET handler; the body is dropped once headers (including Content-Length) are final
+struct HeadMethod {
+  template <typename Next> void operator()(Exchange &exchange, Next &&next) const {
+    next(exchange);
+    if (exchange.request.requestLine.method == Method::Head) {
+      exchange.response.body.clear();
+      exchange.response.file.reset();
+      exchange.response.static_body = {};
+    }
+  }
+};
+
+// Compresses the response when the client accepts gzip. 1xx and 304 responses carry no body and byte
+// ranges refer to the identity encoding, so those are left alone. Bodies sent as file segments, embedded
+// assets or streams are never compressed here.
+struct Gzip {
+  template <typename Next> void operator()(Exchange &exchange, Next &&next) const {
+    next(exchange);
+    auto &response = exchange.response;
+    if (response.responseLine.status.code >= 200 && response.responseLine.status.code != status::NOT_MODIFIED.code &&
+        !response.headers.data.contains("Content-Range") && !response.file && response.static_body.empty() &&
+        !response.streaming) {
+      // Negotiated either way, so caches must key the response on Accept-Encoding
+      response.vary("Accept-Encoding");
+      if (negotiate_encoding(exchange.request) == "gzip") {
+        response.encode_gzip();
+      }
+    }
+  }
+};
+
+} // namespace http
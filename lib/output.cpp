@@ -0,0 +1,91 @@
+#include "output.h"
+#include "config.h"
+
+#include <unistd.h>
+
+namespace net {
+
+File::~File() {
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+void Output::commit(size_t from) {
+  if (from == buffer.size()) {
+    return;
+  }
+  if (!segments.empty()) {
+    if (auto *last = std::get_if<BufferSegment>(&segments.back()); last && last->offset + last->length == from) {
+      last->length = buffer.size() - last->offset;
+      return;
+    }
+  }
+  segments.push_back(BufferSegment{from, buffer.size() - from});
+}
+
+void Output::append(std::string_view bytes) {
+  size_t mark = buffer.size();
+  buffer += bytes;
+  commit(mark);
+}
+
+void Output::append(std::string &&bytes) {
+  if (bytes.size() <= config::INLINE_BODY_SIZE) {
+    append(std::string_view(bytes));
+    return;
+  }
+  segments.push_back(std::move(bytes));
+}
+
+void Output::append(std::shared_ptr<const std::string> bytes) { segments.push_back(std::move(bytes)); }
+
+void Output::append(FileSegment file) {
+  if (file.length > 0) {
+    segments.push_back(std::move(file));
+  }
+}
+
+void Output::append(StaticSegment bytes) {
+  if (bytes.bytes.size() <= config::INLINE_BODY_SIZE) {
+    append(bytes.bytes);
+    return;
+  }
+  segments.push_back(bytes);
+}
+
+void Output::append(SharedSlice slice) {
+  if (slice.length <= config::INLINE_BODY_SIZE) {
+    append(std::string_view(*slice.bytes).substr(slice.offset, slice.length));
+    return;
+  }
+  segments.push_back(std::move(slice));
+}
+
+size_t Output::size() const {
+  size_t total = 0;
+  for (const auto &segment : segments) {
+    total += std::visit(
+        [](const auto &s) -> size_t {
+          using T = std::decay_t<decltype(s)>;
+          if constexpr (std::is_same_v<T, std::string>) {
+            return s.size();
+          } else if constexpr (std::is_same_v<T, std::shared_ptr<const std::string>>) {
+            return s->size();
+          } else if constexpr (std::is_same_v<T, StaticSegment>) {
+            return s.bytes.size();
+          } else {
+            return s.length;
+          }
+        },
+        segment);
+  }
+  return total;
+}
+
+void Output::clear() {
+  buffer.clear();
+  segments.clear();
+}
+
+} // namespace net
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <variant>
+#include <vector>
+
+namespace net {
+
+// An open file descriptor, closed once the last segment referencing it is written
+struct File {
+  int fd;
+
+  explicit File(int fd) : fd(fd) {}
+  File(const File &) = delete;
+  File &operator=(const File &) = delete;
+  ~File();
+};
+
+struct FileSegment {
+  std::shared_ptr<const File> file;
+  off_t offset;
+  size_t length;
+};
+
+// A byte range of Output::buffer, stored as offsets so the buffer may grow
+struct BufferSegment {
+  size_t offset;
+  size_t length;
+};
+
+// Bytes with static storage duration, such as embedded assets; never copied
+struct StaticSegment {
+  std::string_view bytes;
+};
+
+// A byte range of a shared buffer, e.g. one HTTP/2 DATA frame's share of a body
+struct SharedSlice {
+  std::shared_ptr<const std::string> bytes;
+  size_t offset;
+  size_t length;
+};
+
+using Segment = std::variant<BufferSegment, std::string, std::shared_ptr<const std::string>, FileSegment,
+                             StaticSegment, SharedSlice>;
+
+// Response bytes queued for a connection, in write order. Small pieces are copied into `buffer`,
+// large bodies are moved or shared, and files are sent from the page cache.
+struct Output {
+  std::string buffer;
+  std::vector<Segment> segments;
+
+  // Marks buffer[from, end) as the next segment
+  void commit(size_t from);
+  void append(std::string_view bytes);
+  void append(std::string &&bytes);
+  void append(std::shared_ptr<const std::string> bytes);
+  void append(FileSegment file);
+  void append(StaticSegment bytes);
+  void append(SharedSlice slice);
+  size_t size() const;
+  bool empty() const { return segments.empty(); }
+  void clear();
+};
+
+} // namespace net
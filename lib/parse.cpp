@@ -1,5 +1,11 @@
+#include "parse.h"
+#include "config.h"
 #include "types.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
 #include <expected>
+#include <vector>
 
 using namespace std;
 using namespace http;
@@ -8,10 +14,107 @@ namespace {
 
 bool is_valid_path(string_view strv) { return strv[0] == '/' && strv.find(' ') == string_view::npos; }
 
+string_view trim(string_view strv) {
+  while (!strv.empty() && strv.front() == ' ') {
+    strv.remove_prefix(1);
+  }
+  while (!strv.empty() && strv.back() == ' ') {
+    strv.remove_suffix(1);
+  }
+  return strv;
+}
+
+optional<size_t> parse_offset(string_view strv) {
+  size_t value = 0;
+  auto [ptr, ec] = from_chars(strv.data(), strv.data() + strv.size(), value);
+  if (strv.empty() || ec != errc{} || ptr != strv.data() + strv.size()) {
+    return nullopt;
+  }
+  return value;
+}
+
+int hex_value(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+// Splits `uri`'s query on `&` and `=`, decoding each key and value where it lies in the copied buffer
+void parse_query(string_view uri, QueryString &query) {
+  query.parsed = true;
+  size_t question = uri.find('?');
+  if (question == string_view::npos) {
+    return;
+  }
+  query.buffer = uri.substr(question + 1);
+  char *data = query.buffer.data();
+  size_t size = query.buffer.size();
+  for (size_t start = 0; start < size;) {
+    size_t end = query.buffer.find('&', start);
+    if (end == string::npos) {
+      end = size;
+    }
+    if (end > start) {
+      size_t eq = string_view(data + start, end - start).find('=');
+      size_t key_end = eq == string_view::npos ? end : start + eq;
+      size_t value = eq == string_view::npos ? end : key_end + 1;
+      query.fields.push_back({static_cast<uint32_t>(start),
+                              static_cast<uint32_t>(percent_decode(data + start, key_end - start, true)),
+                              static_cast<uint32_t>(value),
+                              static_cast<uint32_t>(percent_decode(data + value, end - value, true))});
+    }
+    start = end + 1;
+  }
+}
+
 } // namespace
 
 namespace http {
 
+size_t percent_decode(char *data, size_t length, bool plus_as_space) {
+  if (plus_as_space) {
+    std::replace(data, data + length, '+', ' ');
+  }
+  // Most paths and values carry no escapes
+  auto *escape = static_cast<char *>(memchr(data, '%', length));
+  if (!escape) {
+    return length;
+  }
+  size_t out = escape - data;
+  for (size_t in = out; in < length; ++in) {
+    int high = -1;
+    int low = -1;
+    if (data[in] == '%' && in + 2 < length && (high = hex_value(data[in + 1])) >= 0 &&
+        (low = hex_value(data[in + 2])) >= 0) {
+      data[out++] = static_cast<char>(high << 4 | low);
+      in += 2;
+    } else {
+      data[out++] = data[in];
+    }
+  }
+  return out;
+}
+
+optional<string_view> Request::query(string_view name) const {
+  if (!query_string.parsed) {
+    parse_query(requestLine.uri, query_string);
+  }
+  string_view buffer = query_string.buffer;
+  for (const auto &field : query_string.fields) {
+    if (buffer.substr(field.key, field.key_length) == name) {
+      return buffer.substr(field.value, field.value_length);
+    }
+  }
+  return nullopt;
+}
+
 expected<RequestLine, ParseError> parse_request_line(string_view strv) {
   RequestLine requestLine{};
   // METHOD
@@ -77,6 +180,29 @@ string parse_body(string_view strv, const Headers &headers) {
   return string(strv.substr(0, content_length));
 }
 
+optional<size_t> message_length(string_view strv) {
+  size_t head_end = strv.find("\r\n\r\n");
+  if (head_end == string_view::npos) {
+    return nullopt;
+  }
+  size_t length = head_end + 4;
+  string_view head = strv.substr(0, head_end + 2);
+  size_t pos = head.find("\r\nContent-Length:");
+  if (pos != string_view::npos) {
+    string_view value = head.substr(pos + 17);
+    value = trim(value.substr(0, value.find("\r\n")));
+    auto content_length = parse_offset(value);
+    if (!content_length) {
+      return length; // parse_request rejects or ignores it
+    }
+    length += *content_length;
+  }
+  if (length > strv.size()) {
+    return nullopt;
+  }
+  return length;
+}
+
 expected<Request, ParseError> parse_request(string_view strv) {
   Request request{};
   size_t request_line_end = strv.find("\r\n");
@@ -104,5 +230,72 @@ expected<Request, ParseError> parse_request(string_view strv) {
   return request;
 }
 
-} // namespace http
+expected<vector<ByteRange>, ParseError> parse_range(string_view strv, size_t size) {
+  if (!strv.starts_with("bytes=")) {
+    return unexpected(ParseError::MalformedRange);
+  }
+  strv.remove_prefix(6);
+  vector<ByteRange> ranges;
+  size_t specs = 0;
+  while (!strv.empty()) {
+    size_t comma = strv.find(',');
+    string_view spec = trim(strv.substr(0, comma));
+    strv.remove_prefix(comma == string_view::npos ? strv.size() : comma + 1);
+    if (++specs > config::MAX_RANGES) {
+      return unexpected(ParseError::MalformedRange);
+    }
+    size_t dash = spec.find('-');
+    if (dash == string_view::npos) {
+      return unexpected(ParseError::MalformedRange);
+    }
+    string_view first = spec.substr(0, dash);
+    string_view last = spec.substr(dash + 1);
+    if (first.empty()) {
+      // suffix range: the final N bytes
+      auto suffix = parse_offset(last);
+      if (!suffix) {
+        return unexpected(ParseError::MalformedRange);
+      }
+      if (*suffix > 0 && size > 0) {
+        ranges.push_back({size - min(*suffix, size), size - 1});
+      }
+      continue;
+    }
+    auto start = parse_offset(first);
+    auto end = last.empty() ? optional<size_t>(size - 1) : parse_offset(last);
+    if (!start || !end || (!last.empty() && *end < *start)) {
+      return unexpected(ParseError::MalformedRange);
+    }
+    if (*start < size) {
+      ranges.push_back({*start, min(*end, size - 1)});
+    }
+  }
+  if (specs == 0) {
+    return unexpected(ParseError::MalformedRange);
+  }
+  if (ranges.empty()) {
+    return unexpected(ParseError::UnsatisfiableRange);
+  }
+  return ranges;
+}
+
+bool iequals(string_view a, string_view b) {
+  return a.size() == b.size() &&
+         equal(a.begin(), a.end(), b.begin(), [](char x, char y) { return tolower(x) == tolower(y); });
+}
 
+bool has_token(string_view list, string_view token) {
+  while (!list.empty()) {
+    size_t comma = list.find(',');
+    if (iequals(trim(list.substr(0, comma)), token)) {
+      return true;
+    }
+    if (comma == string_view::npos) {
+      break;
+    }
+    list.remove_prefix(comma + 1);
+  }
+  return false;
+}
+
+} // namespace http
@@ -2,12 +2,24 @@
 
 #include <expected>
 #include <types.h>
+#include <vector>
 
 namespace http {
 
 std::expected<http::RequestLine, ParseError> parse_request_line(std::string_view strv);
 std::expected<http::Headers, ParseError> parse_headers(std::string_view strv);
 std::expected<http::Request, ParseError> parse_request(std::string_view strv);
+// Size of the first message in `strv` (head + Content-Length body), or nullopt while it is incomplete
+std::optional<size_t> message_length(std::string_view strv);
+std::expected<std::vector<http::ByteRange>, ParseError> parse_range(std::string_view strv, size_t size);
+// Decodes `%XX` escapes (and `+` when `plus_as_space`) in place, returning the new length.
+// Malformed escapes are kept as-is.
+size_t percent_decode(char *data, size_t length, bool plus_as_space = false);
+// ASCII case-insensitive comparison, for tokens such as header values
+bool iequals(std::string_view a, std::string_view b);
+// Whether the comma-separated token list (e.g. `Connection: keep-alive, Upgrade`) contains `token`,
+// ignoring case
+bool has_token(std::string_view list, std::string_view token);
 
 } // namespace http
 
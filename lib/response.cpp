@@ -1,14 +1,178 @@
 #include "response.h"
+#include "config.h"
+#include "parse.h"
 
-#include <fstream>
-#include <sstream>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <zlib.h>
 
+namespace {
+
+constexpr std::string_view SERVER_HEADER = "Server: http-server-cpp\r\n";
+
+struct StatusLine {
+  http::Status status;
+  std::string line;
+};
+
+const std::vector<StatusLine> &status_lines() {
+  static const std::vector<StatusLine> lines = [] {
+    std::vector<StatusLine> lines;
+    for (auto status : {http::status::SWITCHING_PROTOCOLS, http::status::OK, http::status::CREATED,
+                        http::status::PARTIAL_CONTENT, http::status::NOT_MODIFIED, http::status::BAD_REQUEST,
+                        http::status::NOT_FOUND, http::status::CONTENT_TOO_LARGE, http::status::RANGE_NOT_SATISFIABLE,
+                        http::status::EXPECTATION_FAILED, http::status::REQUEST_HEADER_FIELDS_TOO_LARGE,
+                        http::status::INTERNAL_SERVER_ERROR, http::status::SERVICE_UNAVAILABLE}) {
+      lines.push_back({status, http::VERSION + " " + std::to_string(status.code) + " " + status.reason + "\r\n"});
+    }
+    return lines;
+  }();
+  return lines;
+}
+
+// Pre-rendered for the statuses this server produces; empty for anything else
+std::string_view status_line(http::Status status) {
+  for (const auto &entry : status_lines()) {
+    if (entry.status.code == status.code && strcmp(entry.status.reason, status.reason) == 0) {
+      return entry.line;
+    }
+  }
+  return {};
+}
+
+// `Date: <IMF-fixdate>\r\n`, re-rendered at most once per second per thread
+std::string_view date_header() {
+  thread_local std::time_t rendered_at = -1;
+  thread_local char buf[64];
+  thread_local size_t len = 0;
+  std::time_t now = std::time(nullptr);
+  if (now != rendered_at) {
+    struct tm tm;
+    gmtime_r(&now, &tm);
+    len = strftime(buf, sizeof(buf), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+    rendered_at = now;
+  }
+  return {buf, len};
+}
+
+bool read_range(int fd, off_t offset, size_t length, std::string &out) {
+  size_t start = out.size();
+  out.resize(start + length);
+  size_t done = 0;
+  while (done < length) {
+    ssize_t n = pread(fd, out.data() + start + done, length - done, offset + done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      out.resize(start + done);
+      return false;
+    }
+    done += n;
+  }
+  return true;
+}
+
+std::string make_etag(const struct stat &st) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "\"%lx-%lx-%lx\"", static_cast<unsigned long>(st.st_ino),
+           static_cast<unsigned long>(st.st_size), static_cast<unsigned long>(st.st_mtime));
+  return buf;
+}
+
+// Weak comparison (RFC 9110 8.8.3.2)
+bool etag_matches(std::string_view candidate, std::string_view etag) {
+  if (candidate.starts_with("W/")) {
+    candidate.remove_prefix(2);
+  }
+  return candidate == etag;
+}
+
+bool accepts_gzip(const http::Request &request) {
+  auto ae = request.headers.data.find("Accept-Encoding");
+  return ae != request.headers.data.end() && ae->second.find("gzip") != std::string::npos;
+}
+
+// The validator of the gzip representation, as encode_gzip derives it
+std::string gzip_etag(std::string etag) {
+  etag.insert(etag.size() - 1, "-gzip");
+  return etag;
+}
+
+bool if_none_match(std::string_view header, std::string_view etag) {
+  while (!header.empty()) {
+    size_t comma = header.find(',');
+    std::string_view candidate = header.substr(0, comma);
+    while (!candidate.empty() && candidate.front() == ' ') {
+      candidate.remove_prefix(1);
+    }
+    while (!candidate.empty() && candidate.back() == ' ') {
+      candidate.remove_suffix(1);
+    }
+    if (candidate == "*" || etag_matches(candidate, etag)) {
+      return true;
+    }
+    if (comma == std::string_view::npos) {
+      break;
+    }
+    header.remove_prefix(comma + 1);
+  }
+  return false;
+}
+
+// A Range is only honored when If-Range (if any) still matches the current representation
+bool if_range(const http::Request &request, std::string_view etag, std::time_t mtime) {
+  auto it = request.headers.data.find("If-Range");
+  if (it == request.headers.data.end()) {
+    return true;
+  }
+  if (it->second.starts_with('"')) {
+    return it->second == etag;
+  }
+  auto date = http::parse_http_date(it->second);
+  return date && mtime == *date;
+}
+
+bool not_modified(const http::Request &request, std::string_view etag, std::time_t mtime) {
+  const auto &data = request.headers.data;
+  // If-None-Match takes precedence over If-Modified-Since (RFC 9110 13.2.2)
+  if (auto inm = data.find("If-None-Match"); inm != data.end()) {
+    return if_none_match(inm->second, etag);
+  }
+  if (auto ims = data.find("If-Modified-Since"); ims != data.end()) {
+    auto since = http::parse_http_date(ims->second);
+    return since && mtime <= *since;
+  }
+  return false;
+}
+
+} // namespace
+
 namespace http {
 
+std::string format_http_date(std::time_t time) {
+  struct tm tm;
+  gmtime_r(&time, &tm);
+  char buf[32];
+  strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+  return buf;
+}
+
+std::optional<std::time_t> parse_http_date(std::string_view strv) {
+  struct tm tm{};
+  std::string str(strv);
+  const char *end = strptime(str.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+  if (!end || *end != '\0') {
+    return std::nullopt;
+  }
+  return timegm(&tm);
+}
+
 void Response::set_status(Status status) { responseLine.status = status; }
 
-void Response::set_content_length() { headers.set("Content-Length", std::to_string(body.size())); }
+void Response::set_content_length() { headers.set("Content-Length", std::to_string(body_size())); }
 
 void Response::send(std::string content) {
   body = std::move(content);
@@ -17,20 +181,148 @@ void Response::send(std::string content) {
 }
 
 void Response::send_file(const std::string &path) {
-  std::ifstream file(path, std::ios::binary);
-  if (!file) {
+  auto file = std::make_shared<const net::File>(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+  struct stat st;
+  if (file->fd < 0 || fstat(file->fd, &st) != 0 || !S_ISREG(st.st_mode)) {
     set_status(status::NOT_FOUND);
     return;
   }
-  std::ostringstream ss;
-  ss << file.rdbuf();
-  body = ss.str();
+  set_file_headers(st);
+  if (!send_range(file, 0, st.st_size)) {
+    set_status(status::INTERNAL_SERVER_ERROR);
+    return;
+  }
   headers.set("Content-Type", "application/octet-stream");
   set_content_length();
   set_status(status::OK);
 }
 
+void Response::send_file(const std::string &path, const Request &request) {
+  auto file = std::make_shared<const net::File>(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+  struct stat st;
+  if (file->fd < 0 || fstat(file->fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    set_status(status::NOT_FOUND);
+    return;
+  }
+  set_file_headers(st);
+  const auto etag = headers.data["ETag"];
+  // Small files are sent from `body`, which Gzip compresses for clients that accept it. The 304 must
+  // carry the validator of the representation the 200 would have been.
+  bool encodable = static_cast<size_t>(st.st_size) < config::SENDFILE_THRESHOLD;
+  if (encodable) {
+    vary("Accept-Encoding");
+  }
+  std::string representation = encodable && accepts_gzip(request) ? gzip_etag(etag) : etag;
+  if (not_modified(request, representation, st.st_mtime)) {
+    headers.set("ETag", representation);
+    set_status(status::NOT_MODIFIED);
+    return;
+  }
+
+  std::vector<ByteRange> ranges{{0, static_cast<size_t>(st.st_size) - 1}};
+  auto range = request.headers.data.find("Range");
+  if (range != request.headers.data.end() && if_range(request, etag, st.st_mtime)) {
+    auto parsed = parse_range(range->second, st.st_size);
+    if (parsed) {
+      ranges = std::move(*parsed);
+    } else if (parsed.error() == ParseError::UnsatisfiableRange) {
+      headers.set("Content-Range", "bytes */" + std::to_string(st.st_size));
+      set_status(status::RANGE_NOT_SATISFIABLE);
+      return;
+    }
+    // A malformed Range header is ignored and the full file is sent
+  } else {
+    range = request.headers.data.end();
+  }
+
+  if (range == request.headers.data.end() || st.st_size == 0) {
+    if (!send_range(file, 0, st.st_size)) {
+      set_status(status::INTERNAL_SERVER_ERROR);
+      return;
+    }
+    headers.set("Content-Type", "application/octet-stream");
+    set_content_length();
+    set_status(status::OK);
+    return;
+  }
+
+  std::string total = "/" + std::to_string(st.st_size);
+  if (ranges.size() == 1) {
+    const auto &r = ranges.front();
+    if (!send_range(file, r.first, r.length())) {
+      set_status(status::INTERNAL_SERVER_ERROR);
+      return;
+    }
+    headers.set("Content-Type", "application/octet-stream");
+    headers.set("Content-Range", "bytes " + std::to_string(r.first) + "-" + std::to_string(r.last) + total);
+  } else {
+    // multipart/byteranges (RFC 9110 14.6); the ETag is unique per file version, so it makes a safe boundary
+    std::string boundary = etag.substr(1, etag.size() - 2);
+    for (const auto &r : ranges) {
+      body += "\r\n--" + boundary + "\r\nContent-Type: application/octet-stream\r\nContent-Range: bytes " +
+              std::to_string(r.first) + "-" + std::to_string(r.last) + total + "\r\n\r\n";
+      if (!read_range(file->fd, r.first, r.length(), body)) {
+        set_status(status::INTERNAL_SERVER_ERROR);
+        return;
+      }
+    }
+    body += "\r\n--" + boundary + "--\r\n";
+    headers.set("Content-Type", "multipart/byteranges; boundary=" + boundary);
+  }
+  set_content_length();
+  set_status(status::PARTIAL_CONTENT);
+}
+
+// Small ranges are read into the body; large ones become a file segment written with sendfile
+bool Response::send_range(const std::shared_ptr<const net::File> &source, off_t offset, size_t length) {
+  if (length < config::SENDFILE_THRESHOLD) {
+    return read_range(source->fd, offset, length, body);
+  }
+  file = net::FileSegment{source, offset, length};
+  return true;
+}
+
+void Response::send_asset(const Asset &asset, const Request &request) {
+  bool gzip = !asset.gzip.empty() && accepts_gzip(request);
+  std::string etag = gzip ? gzip_etag(std::string(asset.etag)) : std::string(asset.etag);
+  if (gzip) {
+    headers.set("Content-Encoding", "gzip");
+  }
+  headers.set("ETag", etag);
+  vary("Accept-Encoding");
+  if (auto inm = request.headers.data.find("If-None-Match");
+      inm != request.headers.data.end() && if_none_match(inm->second, etag)) {
+    set_status(status::NOT_MODIFIED);
+    return;
+  }
+  static_body = gzip ? asset.gzip : asset.data;
+  headers.set("Content-Type", std::string(asset.content_type));
+  set_content_length();
+  set_status(status::OK);
+}
+
+void Response::vary(std::string_view header) {
+  auto &value = headers.data["Vary"];
+  if (value.empty()) {
+    value = header;
+  } else if (value.find(header) == std::string::npos) {
+    value += ", ";
+    value += header;
+  }
+}
+
+void Response::set_file_headers(const struct stat &st) {
+  headers.set("ETag", make_etag(st));
+  headers.set("Last-Modified", format_http_date(st.st_mtime));
+  headers.set("Accept-Ranges", "bytes");
+}
+
 void Response::encode_gzip() {
+  // File segments go out untouched through sendfile; embedded assets carry their own gzip variant.
+  // Streamed bodies are written later by a session.
+  if (file || !static_body.empty() || streaming) {
+    return;
+  }
   z_stream zs{};
   deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
 
@@ -50,19 +342,94 @@ void Response::encode_gzip() {
 
   body = std::move(compressed);
   headers.set("Content-Encoding", "gzip");
+  // The gzip representation needs its own validator
+  if (auto etag = headers.data.find("ETag"); etag != headers.data.end() && etag->second.ends_with('"')) {
+    etag->second = gzip_etag(std::move(etag->second));
+  }
   set_content_length();
 }
 
-std::string Response::to_str() const {
-  std::string result =
-      VERSION + " " + std::to_string(responseLine.status.code) + " " + responseLine.status.reason + "\r\n";
+size_t Response::body_size() const {
+  if (file) {
+    return file->length;
+  }
+  return static_body.empty() ? body.size() : static_body.size();
+}
+
+void Response::write_head(std::string &out) const {
+  auto line = status_line(responseLine.status);
+  if (line.empty()) {
+    out += VERSION;
+    out += ' ';
+    out += std::to_string(responseLine.status.code);
+    out += ' ';
+    out += responseLine.status.reason;
+    out += "\r\n";
+  } else {
+    out += line;
+  }
+  out += date_header();
+  write_fields(out);
+}
+
+void Response::write_fields(std::string &out) const {
   for (const auto &[key, value] : headers.data) {
-    result += key + ": " + value + "\r\n";
+    out += key;
+    out += ": ";
+    out += value;
+    out += "\r\n";
+  }
+  // Without a length a keep-alive client cannot tell where a bodiless response ends. 1xx and 304
+  // responses never carry one, and a streamed body ends with the connection.
+  if (responseLine.status.code >= 200 && responseLine.status.code != status::NOT_MODIFIED.code && !streaming &&
+      !headers.data.contains("Content-Length")) {
+    out += "Content-Length: ";
+    out += std::to_string(body_size());
+    out += "\r\n";
+  }
+  out += SERVER_HEADER;
+  out += "\r\n";
+}
+
+void Response::write_to(net::Output &out) {
+  size_t mark = out.buffer.size();
+  write_head(out.buffer);
+  out.commit(mark);
+  if (file) {
+    out.append(std::move(*file));
+    file.reset();
+  } else if (!static_body.empty()) {
+    out.append(net::StaticSegment{static_body});
+  } else if (!body.empty()) {
+    out.append(std::move(body));
   }
-  result += "\r\n";
+}
+
+std::string Response::to_str() const {
+  std::string result;
+  result.reserve(256 + body.size() + static_body.size());
+  write_head(result);
   result += body;
+  result += static_body;
   return result;
 }
 
-} // namespace http
+std::string Response::to_cached() const {
+  std::string result;
+  result.reserve(256 + body.size() + static_body.size());
+  write_fields(result);
+  result += body;
+  result += static_body;
+  return result;
+}
 
+void write_cached(net::Output &out, std::shared_ptr<const std::string> cached) {
+  // Cached bytes outlive many seconds, so the Date line is spliced in per response
+  size_t mark = out.buffer.size();
+  out.buffer += status_line(status::OK);
+  out.buffer += date_header();
+  out.commit(mark);
+  out.append(std::move(cached));
+}
+
+} // namespace http
@@ -1,8 +1,13 @@
 #pragma once
 
+#include "assets.h"
+#include "output.h"
 #include "types.h"
+#include <ctime>
 #include <functional>
+#include <optional>
 #include <string>
+#include <sys/stat.h>
 
 namespace http {
 
@@ -15,15 +20,43 @@ struct Response {
   ResponseLine responseLine;
   Headers headers;
   std::string body;
+  std::optional<net::FileSegment> file; // sent instead of `body` for large files
+  std::string_view static_body;         // sent instead of `body` for embedded assets
+  bool streaming = false;               // the body follows from a session until the connection closes
 
   void set_status(Status status);
   void set_content_length();
   void send(std::string body);
   void send_file(const std::string &path);
+  // Honors If-None-Match / If-Modified-Since (304) and Range / If-Range (206, 416),
+  // reading only the requested byte ranges from the file
+  void send_file(const std::string &path, const Request &request);
+  // Serves the precompressed variant when the client accepts gzip; honors If-None-Match (304)
+  void send_asset(const Asset &asset, const Request &request);
   void encode_gzip();
+  // Adds `header` to Vary: the response depends on that request header
+  void vary(std::string_view header);
+  // Appends the status line and headers (plus Date and Server) to `out`; the body is sent separately
+  void write_head(std::string &out) const;
   std::string to_str() const;
+  // Headers and body without the status line and Date, for the response cache; see write_cached
+  std::string to_cached() const;
+  // Queues head and body on `out`; the body is moved, not copied
+  void write_to(net::Output &out);
+
+private:
+  size_t body_size() const;
+  void write_fields(std::string &out) const;
+  bool send_range(const std::shared_ptr<const net::File> &source, off_t offset, size_t length);
+  void set_file_headers(const struct stat &st);
 };
 
+// Queues a 200 response stored from Response::to_cached, with the current Date
+void write_cached(net::Output &out, std::shared_ptr<const std::string> cached);
+
+std::string format_http_date(std::time_t time);
+std::optional<std::time_t> parse_http_date(std::string_view strv);
+
 using RouteHandler = std::function<void(const Request &, Response &)>;
 
 } // namespace http
@@ -1,43 +1,60 @@
 #include "route.h"
+#include "epoch.h"
+#include "parse.h"
 #include "types.h"
 
+#include <algorithm>
+#include <atomic>
+#include <charconv>
 #include <functional>
+#include <map>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 using namespace std;
 using namespace http;
 
 namespace {
 
+// Mutable trie that registration edits; never read by request dispatch
 struct RouteNode {
-public:
-  const unordered_map<string, RouteNode> &get_children() const { return this->children; }
-  optional<RouteHandler> get_handler(Method method) const {
-    auto it = this->handlers.find(method);
-    if (it != this->handlers.end()) {
-      return it->second;
-    }
-    return nullopt;
-  }
+  map<string, RouteNode> children; // ordered, so snapshots list children sorted
+  unordered_map<Method, shared_ptr<const Route>> routes;
+};
 
-  RouteNode &add_child(const string str) {
-    auto it = this->children.find(str);
-    if (it == this->children.end()) {
-      return this->children[str] = RouteNode{};
-    }
-    return this->children[str];
-  }
+// Immutable, compacted form of the trie that requests are matched against. Nodes, edges and
+// segment text live in flat arrays; a node's exact children are sorted for binary search.
+struct Snapshot {
+  struct Edge {
+    uint32_t text;   // offset into `strings`
+    uint32_t length;
+    uint32_t node;
+  };
+  struct Node {
+    uint32_t first_exact;
+    uint32_t exact_count;
+    uint32_t first_param; // `:`-prefixed children, name stored without the colon
+    uint32_t param_count;
+    int32_t routes[METHOD_COUNT]; // index into `routes` per Method, -1 when absent
+  };
 
-  void add_handler(Method method, RouteHandler handler) { this->handlers[method] = handler; }
+  string strings;
+  vector<Node> nodes;
+  vector<Edge> edges;
+  vector<shared_ptr<const Route>> routes;
 
-private:
-  unordered_map<string, RouteNode> children;
-  unordered_map<Method, RouteHandler> handlers;
+  string_view text(const Edge &edge) const { return string_view(strings).substr(edge.text, edge.length); }
 };
 
-RouteNode root;
+mutex registry_mutex; // serializes writers; readers never take it
+RouteNode registry;
+thread_local RouteNode *reload_target = nullptr; // set while reload_routes collects a new table
+atomic<const Snapshot *> current{nullptr};
+atomic<bool> unpublished{false}; // `registry` changed since `current` was compiled from it
+EpochDomain epochs;
 
 void normalize_route(string &route) {
   if (route.starts_with('/')) {
@@ -50,83 +67,231 @@ void normalize_route(string &route) {
 
 RouteNode &create_route_internal(RouteNode &node, string_view route) {
   if (route.empty()) {
-    return node.add_child("");
+    return node.children[""];
   }
   auto pos = route.find('/');
-  auto chunk = route.substr(0, pos);
-  auto &next = node.add_child(string{chunk});
+  auto &next = node.children[string{route.substr(0, pos)}];
   route.remove_prefix(pos + 1);
   return create_route_internal(next, route);
 }
 
-const RouteNode *find_route(const RouteNode &node, string_view route, Params &params) {
-  const auto &children = node.get_children();
-  if (route.empty()) {
-    auto it = children.find("");
-    if (it == children.end()) {
-      return nullptr;
+uint32_t compile(const RouteNode &node, Snapshot &snapshot) {
+  uint32_t index = snapshot.nodes.size();
+  snapshot.nodes.push_back({});
+  for (size_t i = 0; i < METHOD_COUNT; ++i) {
+    auto method = static_cast<Method>(i);
+    auto it = node.routes.find(method);
+    int32_t route = -1;
+    if (it != node.routes.end()) {
+      route = snapshot.routes.size();
+      snapshot.routes.push_back(it->second);
+    }
+    snapshot.nodes[index].routes[i] = route;
+  }
+  // Edges of one node are contiguous: reserve them before recursing into the children
+  vector<pair<const string *, const RouteNode *>> exact, params;
+  for (const auto &[key, child] : node.children) {
+    (key.starts_with(':') ? params : exact).emplace_back(&key, &child);
+  }
+  auto add_edges = [&](const auto &group, size_t skip) {
+    uint32_t first = snapshot.edges.size();
+    for (const auto &[key, child] : group) {
+      snapshot.edges.push_back({static_cast<uint32_t>(snapshot.strings.size()),
+                                static_cast<uint32_t>(key->size() - skip), 0});
+      snapshot.strings.append(*key, skip);
+    }
+    for (size_t i = 0; i < group.size(); ++i) {
+      uint32_t child = compile(*group[i].second, snapshot);
+      snapshot.edges[first + i].node = child;
     }
-    return &it->second;
+    return first;
+  };
+  uint32_t first_exact = add_edges(exact, 0);
+  uint32_t first_param = add_edges(params, 1);
+  auto &compiled = snapshot.nodes[index];
+  compiled.first_exact = first_exact;
+  compiled.exact_count = exact.size();
+  compiled.first_param = first_param;
+  compiled.param_count = params.size();
+  return index;
+}
+
+// Swaps in a snapshot of `root`; the previous one is freed once no reader still matches against it
+void publish(const RouteNode &root) {
+  auto *snapshot = new Snapshot();
+  compile(root, *snapshot);
+  const Snapshot *previous = current.exchange(snapshot);
+  if (previous) {
+    epochs.retire([previous] { delete previous; });
+  }
+}
+
+// create_route only marks the registry changed, and the next match compiles it. Registering n routes
+// at startup then costs one compile, not one per route.
+void publish_pending() {
+  if (!unpublished.load(memory_order_acquire)) {
+    return;
+  }
+  lock_guard lock(registry_mutex);
+  if (unpublished.load(memory_order_relaxed)) {
+    publish(registry);
+    unpublished.store(false, memory_order_relaxed);
+  }
+}
+
+const Snapshot::Edge *find_exact(const Snapshot &snapshot, const Snapshot::Node &node, string_view segment) {
+  auto first = snapshot.edges.begin() + node.first_exact;
+  auto last = first + node.exact_count;
+  auto it = lower_bound(first, last, segment,
+                        [&snapshot](const Snapshot::Edge &edge, string_view s) { return snapshot.text(edge) < s; });
+  return it != last && snapshot.text(*it) == segment ? &*it : nullptr;
+}
+
+const Snapshot::Node *find_route(const Snapshot &snapshot, const Snapshot::Node &node, string_view route,
+                                 Params &params) {
+  if (route.empty()) {
+    auto *end = find_exact(snapshot, node, "");
+    return end ? &snapshot.nodes[end->node] : nullptr;
   }
   auto pos = route.find('/');
   string segment = string(route.substr(0, pos));
   route.remove_prefix(pos + 1);
+  segment.resize(percent_decode(segment.data(), segment.size()));
+  // An encoded `/` or NUL must not smuggle extra path components into a parameter
+  if (segment.find_first_of(string_view("/\0", 2)) != string::npos) {
+    return nullptr;
+  }
 
   // 1. Exact match
-  auto it = children.find(segment);
-  if (it != children.end()) {
-    auto *result = find_route(it->second, route, params);
-    if (result) {
+  if (auto *edge = find_exact(snapshot, node, segment)) {
+    if (auto *result = find_route(snapshot, snapshot.nodes[edge->node], route, params)) {
       return result;
     }
   }
 
   // 2. Fallback to param match (`:` prefixed child)
-  for (const auto &[key, child] : children) {
-    if (key.starts_with(':')) {
-      params[key.substr(1)] = segment;
-      auto *result = find_route(child, route, params);
-      if (result) {
-        return result;
-      }
-      params.erase(key.substr(1));
+  for (uint32_t i = 0; i < node.param_count; ++i) {
+    const auto &edge = snapshot.edges[node.first_param + i];
+    string name(snapshot.text(edge));
+    params[name] = segment;
+    if (auto *result = find_route(snapshot, snapshot.nodes[edge.node], route, params)) {
+      return result;
     }
+    params.erase(name);
   }
 
   return nullptr;
 }
+
+shared_ptr<const Route> route_for(const Snapshot &snapshot, const Snapshot::Node &node, Method method) {
+  int32_t index = node.routes[static_cast<size_t>(method)];
+  if (index < 0) {
+    return nullptr;
+  }
+  return snapshot.routes[index];
+}
 } // namespace
 
 namespace http {
 
-void create_route(Method method, string route, RouteHandler handler) {
+void create_route(Method method, string route, RouteHandler handler, RouteOptions options) {
   normalize_route(route);
-  RouteNode &end = create_route_internal(root, route);
-  end.add_handler(method, handler);
+  if (reload_target) {
+    create_route_internal(*reload_target, route).routes[method] =
+        make_shared<const Route>(std::move(handler), std::move(options));
+    return;
+  }
+  lock_guard lock(registry_mutex);
+  create_route_internal(registry, route).routes[method] =
+      make_shared<const Route>(std::move(handler), std::move(options));
+  unpublished.store(true, memory_order_release);
 }
 
-void get(string route, RouteHandler handler) {
-  create_route(Method::Get, std::move(route), [handler = std::move(handler)](const Request &req, Response &res) {
-    res.set_status(status::OK);
-    handler(req, res);
-  });
+void reload_routes(const function<void()> &define) {
+  RouteNode table;
+  reload_target = &table;
+  define();
+  reload_target = nullptr;
+  lock_guard lock(registry_mutex);
+  registry = std::move(table);
+  publish(registry);
+  unpublished.store(false, memory_order_relaxed);
 }
 
-void post(string route, RouteHandler handler) {
-  create_route(Method::Post, std::move(route), [handler = std::move(handler)](const Request &req, Response &res) {
-    res.set_status(status::CREATED);
-    handler(req, res);
-  });
+void get(string route, RouteHandler handler, RouteOptions options) {
+  create_route(
+      Method::Get, std::move(route),
+      [handler = std::move(handler)](const Request &req, Response &res) {
+        res.set_status(status::OK);
+        handler(req, res);
+      },
+      std::move(options));
 }
 
-optional<RouteHandler> get_route_handler(Request &request) {
-  auto route = request.requestLine.uri;
+void post(string route, RouteHandler handler, RouteOptions options) {
+  create_route(
+      Method::Post, std::move(route),
+      [handler = std::move(handler)](const Request &req, Response &res) {
+        res.set_status(status::CREATED);
+        handler(req, res);
+      },
+      std::move(options));
+}
+
+shared_ptr<const Route> match_route(Request &request) {
+  string route(request.path());
   normalize_route(route);
-  auto *end = find_route(root, route, request.params);
+  publish_pending();
+  EpochDomain::Guard guard(epochs);
+  // The guard fences after pinning, so this load cannot move ahead of the pin
+  const Snapshot *snapshot = current.load(memory_order_acquire);
+  if (!snapshot) {
+    return nullptr;
+  }
+  auto *end = find_route(*snapshot, snapshot->nodes[0], route, request.params);
   if (!end) {
+    return nullptr;
+  }
+  auto matched = route_for(*snapshot, *end, request.requestLine.method);
+  // HEAD runs the GET handler; the body is dropped when the response is sent
+  if (!matched && request.requestLine.method == Method::Head) {
+    return route_for(*snapshot, *end, Method::Get);
+  }
+  return matched;
+}
+
+optional<Status> check_request_head(Request &request) {
+  auto route = match_route(request);
+  if (!route) {
+    return status::NOT_FOUND;
+  }
+  return check_request_head(*route, request);
+}
+
+optional<Status> check_request_head(const Route &route, Request &request) {
+  const auto &headers = request.headers.data;
+  if (auto expect = headers.find("Expect"); expect != headers.end() && !iequals(expect->second, "100-continue")) {
+    return status::EXPECTATION_FAILED;
+  }
+  if (auto length = headers.find("Content-Length"); length != headers.end()) {
+    size_t content_length = 0;
+    auto [ptr, ec] = from_chars(length->second.data(), length->second.data() + length->second.size(), content_length);
+    if (ec != errc{} || content_length > route.options.max_body_size) {
+      return status::CONTENT_TOO_LARGE;
+    }
+  }
+  if (route.options.precondition) {
+    return route.options.precondition(request);
+  }
+  return nullopt;
+}
+
+optional<RouteHandler> get_route_handler(Request &request) {
+  auto route = match_route(request);
+  if (!route) {
     return nullopt;
   }
-  return end->get_handler(request.requestLine.method);
+  return route->handler;
 }
 
 } // namespace http
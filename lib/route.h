@@ -1,13 +1,45 @@
 #pragma once
 
+#include "cache.h"
+#include "config.h"
 #include "response.h"
+#include "session.h"
+#include <memory>
 #include <optional>
 #include <string>
 
 namespace http {
-void create_route(http::Method method, std::string route, RouteHandler handler);
-void get(std::string route, RouteHandler handler);
-void post(std::string route, RouteHandler handler);
+
+struct RouteOptions {
+  std::optional<CachePolicy> cache;
+  size_t max_body_size = config::MAX_BODY_SIZE;
+  // Runs on the request head before the body is read; an error status rejects the request early
+  std::function<std::optional<Status>(const Request &)> precondition;
+  // Creates the session that takes over the connection when the handler answers 101 or streams
+  std::function<std::unique_ptr<net::Session>(const Request &)> upgrade;
+};
+
+struct Route {
+  RouteHandler handler;
+  RouteOptions options;
+};
+
+// Registration builds a new immutable route table and publishes it atomically; requests in flight
+// finish against the table they started with
+void create_route(http::Method method, std::string route, RouteHandler handler, RouteOptions options = {});
+void get(std::string route, RouteHandler handler, RouteOptions options = {});
+void post(std::string route, RouteHandler handler, RouteOptions options = {});
+// Replaces every route at once: routes registered by `define` form the new table, which readers
+// switch to in one step. `define` runs on the calling thread.
+void reload_routes(const std::function<void()> &define);
+// Safe on any thread while routes are being registered, and lock-free except for the first match after
+// a registration, which compiles the new table. Routes are shared, not copied, so a match costs no
+// allocation and stays valid after the table is replaced.
+std::shared_ptr<const Route> match_route(Request &request);
 std::optional<RouteHandler> get_route_handler(Request &request);
+// Resolves the route for a request whose body has not arrived yet and applies its limits:
+// 404 without a route, 417 for unknown expectations, 413 above max_body_size, then the precondition
+std::optional<Status> check_request_head(Request &request);
+// The same limits for a request whose route is already resolved
+std::optional<Status> check_request_head(const Route &route, Request &request);
 } // namespace http
-
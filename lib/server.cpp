@@ -1,57 +1,245 @@
 #include "server.h"
+#include "admission.h"
+#include "buffer_pool.h"
 #include "config.h"
+#include "socket.h"
+#include "tls.h"
+#include "transport.h"
 
+#include <algorithm>
 #include <arpa/inet.h>
+#include <cerrno>
+#include <csignal>
 #include <cstring>
-#include <fcntl.h>
 #include <iostream>
-#include <netdb.h>
+#include <memory>
+#include <mutex>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
+#include <variant>
+#include <vector>
 
 namespace {
 
+// Per-connection state, indexed by fd. Idle connections hold no buffers: input and output are
+// borrowed from pools while a request is being read or a response is being written.
+struct Connection {
+  int fd = -1;
+  uint32_t generation = 0; // distinguishes successive connections on the same fd
+  net::PeerKey peer{};
+  net::Buffer input;
+  uint32_t input_len = 0;
+  net::Output *output = nullptr;
+  uint32_t segment = 0; // first segment of `output` not fully written
+  size_t offset = 0;    // bytes of that segment already written
+  bool writing = false;  // waiting for EPOLLOUT
+  bool deferred = false; // read budget exhausted, resumed after the current batch of events
+  bool close_after_write = false;
+  bool admitted = false;   // the request at the front of `input` passed admission control
+  bool needs_input = false; // the handler asked for more bytes than `input` holds
+  bool head_checked = false; // the handler accepted the head of the request at the front of `input`
+  bool handshaking = false; // TLS handshake still in progress
+  bool wake_pending = false; // the session was woken while output was still being written
+  bool in_memory = false;    // loopback: no socket behind `fd` and no epoll registration
+  std::unique_ptr<net::Transport> transport; // TLS or loopback; plain sockets use the syscalls
+  std::unique_ptr<net::Session> session; // set once the connection switched protocols
+};
+
 int server_fd = -1;
+int listen_family = AF_INET;
 int epoll_fd = -1;
+net::Options options;
+std::vector<Connection> connections;
+std::vector<Connection *> deferred;
+net::BufferPool buffer_pool;
+std::vector<std::unique_ptr<net::Output>> spare_outputs;
+size_t outputs_in_use = 0; // connections with an admitted request not yet fully written
+net::Admission admission;
+std::unique_ptr<net::TlsContext> tls_context;
+net::Admission::Clock::time_point batch_start; // when epoll_wait returned the events being handled
+uint32_t last_generation = 0;
+Connection *loopback_connection = nullptr; // the in-memory connection while Loopback::run is going
 
-void set_nonblocking(int fd) {
-  int flags = fcntl(fd, F_GETFL, 0);
-  fcntl(fd, F_SETFL, flags | O_NONBLOCK);
-}
+// Cross-thread wakeups: handles are queued under the lock and the eventfd is signalled once per batch
+std::mutex mailbox_mutex;
+std::vector<net::ConnectionHandle> mailbox;
+int wake_fd = -1;
+Connection wake_marker; // epoll data for wake_fd
+
+constexpr std::string_view TOO_LARGE_RESPONSE = "HTTP/1.1 413 Content Too Large\r\n"
+                                                "Content-Length: 0\r\n"
+                                                "Connection: close\r\n"
+                                                "\r\n";
 
-void epoll_add(int fd, uint32_t events) {
+// `conn` is null for the listening socket
+void epoll_add(int fd, uint32_t events, Connection *conn) {
   struct epoll_event ev;
   ev.events = events;
-  ev.data.fd = fd;
+  ev.data.ptr = conn;
   epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
 }
 
-void setup(uint16_t port) {
-  server_fd = socket(AF_INET, SOCK_STREAM, 0);
-  if (server_fd < 0) {
-    std::cerr << "Failed to create server socket\n";
+void epoll_mod(Connection &conn, uint32_t events) {
+  if (conn.in_memory) {
     return;
   }
+  struct epoll_event ev;
+  ev.events = events;
+  ev.data.ptr = &conn;
+  epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn.fd, &ev);
+}
+
+net::Output *acquire_output() {
+  outputs_in_use++;
+  if (spare_outputs.empty()) {
+    return new net::Output;
+  }
+  auto *output = spare_outputs.back().release();
+  spare_outputs.pop_back();
+  return output;
+}
 
-  int reuse = 1;
-  if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0) {
-    std::cerr << "setsockopt failed\n";
+void release_output(net::Output *output) {
+  outputs_in_use--;
+  if (spare_outputs.size() >= config::SPARE_OUTPUTS) {
+    delete output;
     return;
   }
+  output->clear();
+  // A spike of large responses must not stay allocated in the spares
+  if (output->buffer.capacity() > config::BUFFER_SIZE) {
+    output->buffer = std::string();
+    output->buffer.reserve(config::BUFFER_SIZE);
+  }
+  if (output->segments.capacity() > config::MAX_IOVECS) {
+    output->segments = {};
+  }
+  spare_outputs.emplace_back(output);
+}
 
-  struct sockaddr_in server_addr;
-  server_addr.sin_family = AF_INET;
-  server_addr.sin_addr.s_addr = INADDR_ANY;
-  server_addr.sin_port = htons(port);
+void close_connection(Connection &conn) {
+  if (conn.session) {
+    conn.session->on_close();
+  }
+  if (conn.transport) {
+    conn.transport->shutdown();
+  }
+  if (!conn.in_memory) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn.fd, nullptr);
+    close(conn.fd);
+  }
+  buffer_pool.release(conn.input);
+  if (conn.output) {
+    release_output(conn.output);
+  }
+  conn = Connection{};
+}
 
-  if (bind(server_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) != 0) {
-    std::cerr << "Failed to bind to port " << port << "\n";
-    return;
+ssize_t read_input(Connection &conn, char *data, size_t length) {
+  return conn.transport ? conn.transport->read(data, length) : read(conn.fd, data, length);
+}
+
+std::string_view segment_bytes(const net::Output &output, const net::Segment &segment) {
+  if (const auto *range = std::get_if<net::BufferSegment>(&segment)) {
+    return std::string_view(output.buffer).substr(range->offset, range->length);
+  }
+  if (const auto *owned = std::get_if<std::string>(&segment)) {
+    return *owned;
+  }
+  if (const auto *embedded = std::get_if<net::StaticSegment>(&segment)) {
+    return embedded->bytes;
+  }
+  if (const auto *slice = std::get_if<net::SharedSlice>(&segment)) {
+    return std::string_view(*slice->bytes).substr(slice->offset, slice->length);
+  }
+  return *std::get<std::shared_ptr<const std::string>>(segment);
+}
+
+void advance(Connection &conn, size_t written) {
+  const auto &segments = conn.output->segments;
+  while (written > 0) {
+    const auto &segment = segments[conn.segment];
+    size_t length = std::holds_alternative<net::FileSegment>(segment) ? std::get<net::FileSegment>(segment).length
+                                                                      : segment_bytes(*conn.output, segment).size();
+    size_t step = std::min(written, length - conn.offset);
+    conn.offset += step;
+    written -= step;
+    if (conn.offset == length) {
+      conn.segment++;
+      conn.offset = 0;
+    }
+  }
+}
+
+// Writes as much queued output as the socket accepts. Memory segments are gathered into one
+// writev, file segments go through sendfile. Returns false if the connection failed.
+bool flush(Connection &conn) {
+  const auto &segments = conn.output->segments;
+  while (conn.segment < segments.size()) {
+    ssize_t n;
+    if (const auto *file = std::get_if<net::FileSegment>(&segments[conn.segment])) {
+      off_t offset = file->offset + conn.offset;
+      n = conn.transport ? conn.transport->sendfile(file->file->fd, offset, file->length - conn.offset)
+                         : sendfile(conn.fd, file->file->fd, &offset, file->length - conn.offset);
+      if (n == 0) {
+        return false; // file truncated underneath us
+      }
+    } else {
+      struct iovec iov[config::MAX_IOVECS];
+      int iovcnt = 0;
+      for (size_t i = conn.segment; i < segments.size() && iovcnt < config::MAX_IOVECS; i++) {
+        if (std::holds_alternative<net::FileSegment>(segments[i])) {
+          break;
+        }
+        auto bytes = segment_bytes(*conn.output, segments[i]);
+        if (i == conn.segment) {
+          bytes.remove_prefix(conn.offset);
+        }
+        iov[iovcnt++] = {const_cast<char *>(bytes.data()), bytes.size()};
+      }
+      n = conn.transport ? conn.transport->writev(iov, iovcnt) : writev(conn.fd, iov, iovcnt);
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno == EAGAIN;
+    }
+    advance(conn, n);
+  }
+  return true;
+}
+
+void setup(uint16_t port) {
+  struct rlimit limit;
+  size_t slots = config::MAX_CONNECTIONS;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < slots) {
+    slots = limit.rlim_cur;
   }
+  connections.resize(slots);
 
-  set_nonblocking(server_fd);
+  auto address = net::parse_address(options.address, port);
+  if (!address) {
+    std::cerr << "Invalid listen address " << options.address << "\n";
+    return;
+  }
+  listen_family = address->family();
+  if (!options.tls.certificate.empty()) {
+    tls_context = std::make_unique<net::TlsContext>(options.tls);
+    if (!tls_context->valid()) {
+      return;
+    }
+  }
+  server_fd = net::bind_listener(*address, options.socket);
+  if (server_fd < 0) {
+    return;
+  }
 
   epoll_fd = epoll_create1(0);
   if (epoll_fd < 0) {
@@ -59,54 +247,351 @@ void setup(uint16_t port) {
     return;
   }
 
-  epoll_add(server_fd, EPOLLIN);
+  epoll_add(server_fd, EPOLLIN, nullptr);
+
+  int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (fd < 0) {
+    std::cerr << "Failed to create eventfd\n";
+    return;
+  }
+  epoll_add(fd, EPOLLIN, &wake_marker);
+  std::lock_guard lock(mailbox_mutex);
+  wake_fd = fd;
 }
 
 void handle_new_connection() {
-  struct sockaddr_in client_addr;
+  struct sockaddr_storage client_addr;
   socklen_t client_addr_len = sizeof(client_addr);
 
-  int client_fd = accept(server_fd, (struct sockaddr *)&client_addr, &client_addr_len);
+  int client_fd = accept4(server_fd, (struct sockaddr *)&client_addr, &client_addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
   if (client_fd < 0)
     return;
+  if (static_cast<size_t>(client_fd) >= connections.size()) {
+    close(client_fd);
+    return;
+  }
+
+  auto peer = net::peer_key(client_addr);
+  if (admission.enabled() && !admission.admit_connection(peer, net::Admission::Clock::now())) {
+    // A TLS client could not read a plaintext 503
+    size_t sent = 0;
+    if (!tls_context) {
+      auto response = net::Admission::overload_response();
+      sent = std::max<ssize_t>(send(client_fd, response.data(), response.size(), MSG_DONTWAIT | MSG_NOSIGNAL), 0);
+    }
+    if (options.on_reject) {
+      options.on_reject({peer, net::Admission::Clock::now()}, 503, sent);
+    }
+    close(client_fd);
+    return;
+  }
 
-  set_nonblocking(client_fd);
-  epoll_add(client_fd, EPOLLIN);
+  net::tune_client(client_fd, listen_family, options.socket);
+  auto &conn = connections[client_fd];
+  conn.fd = client_fd;
+  conn.generation = ++last_generation;
+  conn.peer = peer;
+  if (tls_context) {
+    conn.transport = std::make_unique<net::TlsStream>(*tls_context, client_fd);
+    conn.handshaking = true;
+  }
+  // Edge-triggered connections are registered for both directions once and never modified
+  epoll_add(client_fd, options.edge_triggered ? EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET : EPOLLIN | EPOLLRDHUP,
+            &conn);
 }
 
-void handle_client(int client_fd, const net::Handler &handler) {
-  char buffer[config::BUFFER_SIZE] = {0};
-  ssize_t bytes = read(client_fd, buffer, config::BUFFER_SIZE - 1);
+// Runs the handler over buffered input until it needs more bytes, asks to close, or enough output
+// is queued; then writes. Unconsumed bytes are moved to the front of the input buffer.
+void process(Connection &conn, const net::Handler &handler) {
+  if (!conn.output) {
+    conn.output = acquire_output();
+  }
+  if (conn.wake_pending) {
+    conn.wake_pending = false;
+    conn.close_after_write |= conn.session->on_wake(*conn.output, false);
+  }
+  uint32_t consumed = 0;
+  net::RequestContext context{conn.peer, batch_start};
+  while (consumed < conn.input_len && !conn.needs_input && !conn.close_after_write &&
+         conn.output->size() < config::MAX_PENDING_OUTPUT) {
+    if (admission.enabled() && !conn.admitted && !conn.session) {
+      auto now = net::Admission::Clock::now();
+      if (!admission.admit_request(conn.peer, outputs_in_use - 1, now - batch_start, now)) {
+        // Shedding: a constant 503, and the rest of the input is dropped with the connection
+        conn.output->append(net::Admission::overload_response());
+        if (options.on_reject) {
+          options.on_reject(context, 503, net::Admission::overload_response().size());
+        }
+        conn.close_after_write = true;
+        consumed = conn.input_len;
+        break;
+      }
+      conn.admitted = true;
+    }
+    std::span<char> input(conn.input.data + consumed, conn.input_len - consumed);
+    context.head_checked = conn.head_checked;
+    auto result = conn.session ? conn.session->on_input(input, *conn.output)
+                               : handler(std::string_view(input.data(), input.size()), *conn.output, context);
+    if (result.upgrade) {
+      conn.session = std::move(result.upgrade);
+      // Sessions trade small frames both ways; Nagle would hold them back behind delayed ACKs
+      if (!conn.in_memory && !options.socket.tcp_nodelay) {
+        net::tune_client(conn.fd, listen_family, {.tcp_nodelay = true});
+      }
+      conn.session->on_open(*conn.output, {conn.fd, conn.generation});
+    }
+    if (result.consumed == 0) {
+      conn.needs_input = true;
+      conn.head_checked = result.head_checked;
+      break;
+    }
+    conn.admitted = false;
+    conn.head_checked = false;
+    consumed += result.consumed;
+    conn.close_after_write = result.close_connection;
+  }
+  if (consumed > 0) {
+    conn.input_len -= consumed;
+    memmove(conn.input.data, conn.input.data + consumed, conn.input_len);
+  }
+  if (conn.input_len == 0) {
+    buffer_pool.release(conn.input);
+  }
 
-  if (bytes <= 0) {
-    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client_fd, nullptr);
-    close(client_fd);
+  if (!flush(conn)) {
+    close_connection(conn);
+    return;
+  }
+  if (conn.segment < conn.output->segments.size()) {
+    if (!conn.writing) {
+      conn.writing = true;
+      // Without EPOLLRDHUP: a half-closed peer would report it on every wait until the write ends.
+      // The EOF is read once the connection is back to reading.
+      if (!options.edge_triggered) {
+        epoll_mod(conn, EPOLLOUT);
+      }
+    }
+    return;
+  }
+  release_output(conn.output);
+  conn.output = nullptr;
+  conn.segment = 0;
+  conn.offset = 0;
+  if (conn.close_after_write) {
+    if (conn.transport) {
+      conn.transport->shutdown();
+    }
+    if (!conn.in_memory) {
+      shutdown(conn.fd, SHUT_WR);
+    }
+    close_connection(conn);
     return;
   }
+  if (conn.writing) {
+    conn.writing = false;
+    if (!options.edge_triggered) {
+      epoll_mod(conn, EPOLLIN | EPOLLRDHUP);
+    }
+  }
+}
 
-  auto result = handler(std::string(buffer, bytes));
-  write(client_fd, result.response.c_str(), result.response.size());
+// A single request larger than the largest pooled buffer, which only routes allowing bodies beyond
+// it reach: answered with a 413 like the handler's own limits. Sessions frame their own errors.
+void reject_oversized(Connection &conn, const net::Handler &handler) {
+  if (conn.session) {
+    close_connection(conn);
+    return;
+  }
+  if (!conn.output) {
+    conn.output = acquire_output();
+  }
+  conn.output->append(TOO_LARGE_RESPONSE);
+  if (options.on_reject) {
+    options.on_reject({conn.peer, batch_start}, 413, TOO_LARGE_RESPONSE.size());
+  }
+  conn.input_len = 0;
+  conn.close_after_write = true;
+  process(conn, handler);
+}
 
-  if (result.close_connection) {
-    shutdown(client_fd, SHUT_WR);
-    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client_fd, nullptr);
-    close(client_fd);
+// Level-triggered: one read per event. Edge-triggered: reads until EAGAIN, but after
+// `read_budget` bytes the connection yields and is resumed once the other ready connections ran.
+void handle_readable(Connection &conn, const net::Handler &handler) {
+  size_t budget = options.read_budget;
+  while (true) {
+    if (!conn.input) {
+      conn.input = buffer_pool.acquire(config::BUFFER_SIZE);
+    } else if (conn.input_len == conn.input.capacity &&
+               !buffer_pool.grow(conn.input, conn.input_len, conn.input.capacity + 1)) {
+      reject_oversized(conn, handler);
+      return;
+    }
+
+    ssize_t bytes = read_input(conn, conn.input.data + conn.input_len, conn.input.capacity - conn.input_len);
+    if (bytes < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN) {
+        close_connection(conn);
+      } else if (conn.input_len == 0) {
+        buffer_pool.release(conn.input);
+      }
+      return;
+    }
+    if (bytes == 0) {
+      // Peer finished sending: deliver what is still queued, then close
+      if (conn.writing) {
+        conn.close_after_write = true;
+      } else {
+        close_connection(conn);
+      }
+      return;
+    }
+    conn.input_len += bytes;
+    conn.needs_input = false;
+    process(conn, handler);
+    // TLS may hold decrypted bytes that epoll will never report, so those are read in any mode
+    if (conn.fd < 0 || conn.writing || (!options.edge_triggered && !(conn.transport && conn.transport->pending()))) {
+      return;
+    }
+    if (static_cast<size_t>(bytes) >= budget) {
+      if (!conn.deferred) {
+        conn.deferred = true;
+        deferred.push_back(&conn);
+      }
+      return;
+    }
+    budget -= bytes;
+  }
+}
+
+void handle_writable(Connection &conn, const net::Handler &handler) {
+  if (!flush(conn)) {
+    close_connection(conn);
+    return;
+  }
+  if (conn.segment < conn.output->segments.size()) {
+    return;
+  }
+  // Output drained: serve any pipelined requests still buffered, or go back to reading
+  conn.output->clear();
+  conn.segment = 0;
+  conn.offset = 0;
+  process(conn, handler);
+  // No new EPOLLIN edge is reported for data that arrived while writing
+  if (options.edge_triggered && conn.fd >= 0 && !conn.writing) {
+    handle_readable(conn, handler);
+  }
+}
+
+// Drives the TLS handshake in whichever direction it waits on; once done, the connection is served
+// like a plain one. The client's first request may already be buffered behind its Finished message.
+void handle_handshake(Connection &conn, const net::Handler &handler) {
+  auto &tls = static_cast<net::TlsStream &>(*conn.transport);
+  if (tls.handshake() < 0) {
+    if (errno != EAGAIN) {
+      close_connection(conn);
+    } else if (!options.edge_triggered) {
+      epoll_mod(conn, (tls.wants_write() ? EPOLLOUT : EPOLLIN) | EPOLLRDHUP);
+    }
+    return;
+  }
+  conn.handshaking = false;
+  if (!options.edge_triggered) {
+    epoll_mod(conn, EPOLLIN | EPOLLRDHUP);
+  }
+  handle_readable(conn, handler);
+}
+
+// The open connection `handle` names, or null once it is stale
+Connection *find_connection(net::ConnectionHandle handle) {
+  Connection *conn = loopback_connection;
+  if (!conn) {
+    if (handle.fd < 0 || static_cast<size_t>(handle.fd) >= connections.size()) {
+      return nullptr;
+    }
+    conn = &connections[handle.fd];
+  }
+  if (conn->fd != handle.fd || conn->generation != handle.generation) {
+    return nullptr;
+  }
+  return conn;
+}
+
+void handle_wakeups(const net::Handler &handler) {
+  uint64_t count;
+  read(wake_fd, &count, sizeof(count));
+  std::vector<net::ConnectionHandle> handles;
+  {
+    std::lock_guard lock(mailbox_mutex);
+    handles.swap(mailbox);
+  }
+  for (auto handle : handles) {
+    auto *found = find_connection(handle);
+    if (!found || !found->session) {
+      continue;
+    }
+    auto &conn = *found;
+    if (conn.writing) {
+      if (conn.session->on_wake(*conn.output, true)) {
+        close_connection(conn);
+      } else {
+        conn.wake_pending = true;
+      }
+      continue;
+    }
+    conn.wake_pending = true;
+    process(conn, handler);
+  }
+}
+
+void handle_event(Connection &conn, uint32_t events, const net::Handler &handler) {
+  if (events & EPOLLERR) {
+    close_connection(conn);
+  } else if (conn.handshaking) {
+    handle_handshake(conn, handler);
+  } else if (conn.writing) {
+    if (events & (EPOLLOUT | EPOLLHUP)) {
+      handle_writable(conn, handler);
+    }
+  } else if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) {
+    handle_readable(conn, handler);
   }
 }
 
 void run(const net::Handler &handler) {
   struct epoll_event events[config::MAX_EVENTS];
+  std::vector<Connection *> resumed;
 
   while (true) {
-    int n = epoll_wait(epoll_fd, events, config::MAX_EVENTS, -1);
+    // Deferred connections still have unread data, so only poll for new events without blocking
+    int n = epoll_wait(epoll_fd, events, config::MAX_EVENTS, deferred.empty() ? -1 : 0);
+    batch_start = net::Admission::Clock::now();
 
     for (int i = 0; i < n; i++) {
-      if (events[i].data.fd == server_fd) {
+      auto *conn = static_cast<Connection *>(events[i].data.ptr);
+      if (!conn) {
         handle_new_connection();
-      } else {
-        handle_client(events[i].data.fd, handler);
+        continue;
+      }
+      if (conn == &wake_marker) {
+        handle_wakeups(handler);
+        continue;
+      }
+      if (conn->fd >= 0) {
+        handle_event(*conn, events[i].events, handler);
+      }
+    }
+
+    resumed.swap(deferred);
+    for (auto *conn : resumed) {
+      conn->deferred = false;
+      if (conn->fd >= 0 && !conn->writing && !conn->handshaking) {
+        handle_readable(*conn, handler);
       }
     }
+    resumed.clear();
   }
 }
 
@@ -114,9 +599,59 @@ void run(const net::Handler &handler) {
 
 namespace net {
 
-Server::Server(uint16_t port) { setup(port); }
+void wake(std::span<const ConnectionHandle> handles) {
+  if (handles.empty()) {
+    return;
+  }
+  std::lock_guard lock(mailbox_mutex);
+  if (wake_fd < 0) {
+    return;
+  }
+  bool notify = mailbox.empty();
+  mailbox.insert(mailbox.end(), handles.begin(), handles.end());
+  if (notify) {
+    uint64_t one = 1;
+    write(wake_fd, &one, sizeof(one));
+  }
+}
+
+bool admit(ConnectionHandle handle, size_t active) {
+  auto *conn = admission.enabled() ? find_connection(handle) : nullptr;
+  if (!conn) {
+    return true;
+  }
+  auto now = Admission::Clock::now();
+  if (admission.admit_request(conn->peer, outputs_in_use - 1 + active, now - batch_start, now)) {
+    return true;
+  }
+  // The session answers in its own framing, so there are no bytes to report here
+  if (options.on_reject) {
+    options.on_reject({conn->peer, batch_start}, 503, 0);
+  }
+  return false;
+}
+
+RequestContext request_context(ConnectionHandle handle) {
+  auto *conn = find_connection(handle);
+  return {conn ? conn->peer : PeerKey{}, batch_start};
+}
+
+Server::Server(uint16_t port, Options opts) {
+  options = opts;
+  admission = Admission(options.admission);
+  // Peers may disappear mid-write; that must surface as EPIPE, not kill the process
+  signal(SIGPIPE, SIG_IGN);
+  setup(port);
+}
 
 Server::~Server() {
+  {
+    std::lock_guard lock(mailbox_mutex);
+    if (wake_fd >= 0) {
+      close(wake_fd);
+      wake_fd = -1;
+    }
+  }
   if (epoll_fd >= 0) {
     close(epoll_fd);
   }
@@ -125,6 +660,37 @@ Server::~Server() {
   }
 }
 
+Loopback::Loopback(Options opts) {
+  options = opts;
+  admission = Admission(options.admission);
+}
+
+std::string Loopback::run(const LoopbackScript &script, const Handler &handler) {
+  std::string received;
+  auto transport = std::make_unique<LoopbackTransport>(script, received);
+  auto &client = *transport;
+  Connection conn;
+  conn.fd = 0;
+  conn.in_memory = true;
+  conn.transport = std::move(transport);
+  loopback_connection = &conn;
+  // One iteration is one readiness event. EOF follows the script, so every connection ends.
+  while (conn.fd >= 0) {
+    client.tick();
+    batch_start = Admission::Clock::now();
+    if (conn.writing) {
+      handle_writable(conn, handler);
+    } else {
+      handle_readable(conn, handler);
+    }
+    // A deferred connection is simply read again on the next event
+    conn.deferred = false;
+    deferred.clear();
+  }
+  loopback_connection = nullptr;
+  return received;
+}
+
 void Server::listen(Handler handler) {
   if (::listen(server_fd, config::CONNECTION_BACKLOG) != 0) {
     std::cerr << "listen failed\n";
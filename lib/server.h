@@ -1,23 +1,65 @@
 #pragma once
 
+#include "admission.h"
+#include "output.h"
+#include "session.h"
+#include "socket.h"
+#include "tls.h"
+#include "transport.h"
 #include <cstdint>
 #include <functional>
 #include <string>
+#include <string_view>
 
 namespace net {
 
-struct HandlerResult {
-  std::string response;
-  bool close_connection;
+// The connection a request arrived on
+struct RequestContext {
+  PeerKey peer;                          // from accept
+  Admission::Clock::time_point received; // when the event loop picked up the request's bytes
+  bool head_checked = false;             // an earlier call for this request returned head_checked
 };
 
-using Handler = std::function<HandlerResult(const std::string &)>;
+// The context of a request a session reads now on the handle's connection, e.g. for its access log.
+// Event loop only; stale handles get no peer.
+RequestContext request_context(ConnectionHandle handle);
+
+// Called with a view of the connection's unread bytes. The handler queues its response on `output`
+// (buffer references and file segments, no whole-message copies) and reports how much input it used.
+using Handler =
+    std::function<HandlerResult(std::string_view input, Output &output, const RequestContext &context)>;
+
+struct Options {
+  // Listen address (see parse_address); empty listens on all IPv4 interfaces at the server's port
+  std::string address;
+  SocketOptions socket;
+  AdmissionOptions admission;
+  // HTTPS when a certificate is set
+  TlsOptions tls;
+  // Register clients with EPOLLET and drain each socket until EAGAIN
+  bool edge_triggered = false;
+  // Bytes one connection may read per wakeup in edge-triggered mode before yielding to others
+  size_t read_budget = 64 * 1024;
+  // Told about requests the server answers without the handler (503 while shedding load, 413 beyond
+  // the largest buffer) with the status and bytes queued, e.g. for the access log
+  std::function<void(const RequestContext &context, uint16_t status, size_t bytes)> on_reject;
+};
 
 struct Server {
-  Server(uint16_t port);
+  Server(uint16_t port, Options options = {});
   ~Server();
 
   void listen(Handler handler);
 };
 
+// Drives the server's connection logic over in-memory transports instead of sockets, so the whole
+// request path can be measured without syscalls. Shares the process-wide connection state with
+// Server: use one or the other. TLS and sessions' cross-thread wakeups are not available.
+struct Loopback {
+  explicit Loopback(Options options = {});
+
+  // Plays `script` as one connection until the server closes it, then returns every byte written
+  std::string run(const LoopbackScript &script, const Handler &handler);
+};
+
 } // namespace net
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "output.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+
+namespace net {
+
+class Session;
+
+// Names a connection from outside the event loop. Handles go stale when the connection closes, even
+// if its fd is reused.
+struct ConnectionHandle {
+  int fd = -1;
+  uint32_t generation = 0;
+};
+
+// Asks the event loop to run `on_wake` for the session on each connection; callable from any thread.
+// Stale handles are ignored.
+void wake(std::span<const ConnectionHandle> handles);
+
+// Admission control for one more request on a session's connection (e.g. a new HTTP/2 stream), as the
+// event loop applies it to each HTTP/1.1 request; `active` counts the session's requests in flight.
+// Refusals are reported to Options::on_reject. Event loop only; true when admission is off.
+bool admit(ConnectionHandle handle, size_t active);
+
+struct HandlerResult {
+  size_t consumed; // bytes of `input` handled; 0 when more data is needed
+  bool close_connection;
+  // Protocol that takes over the connection once this response is queued (e.g. after a 101)
+  std::unique_ptr<Session> upgrade = nullptr;
+  // With consumed == 0: the request's head is in and passed the handler's checks; reported back in
+  // RequestContext::head_checked until the request completes
+  bool head_checked = false;
+};
+
+// A protocol spoken on a connection after an upgrade. It receives the raw bytes that follow the
+// upgrade response and replaces the HTTP handler for the rest of the connection.
+class Session {
+public:
+  virtual ~Session() = default;
+
+  // Called once, right after the upgrade response was queued on `output`; `handle` is for `wake`
+  virtual void on_open(Output & /*output*/, ConnectionHandle /*handle*/) {}
+  // `input` is the connection's own buffer and may be modified in place (e.g. unmasked)
+  virtual HandlerResult on_input(std::span<char> input, Output &output) = 0;
+  // Runs on the event loop after `wake`. While `backlogged`, earlier output is still being written and
+  // the session is called again without it once that is done. Returns true to drop the connection.
+  virtual bool on_wake(Output & /*output*/, bool /*backlogged*/) { return false; }
+  // The connection is going away, for whichever reason
+  virtual void on_close() {}
+};
+
+} // namespace net
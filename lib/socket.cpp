@@ -0,0 +1,191 @@
+#include "socket.h"
+
+#include <arpa/inet.h>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+// Tuning options are best effort: a failure is reported but the listener still starts
+void set_option(int fd, int level, int name, int value, const char *label) {
+  if (setsockopt(fd, level, name, &value, sizeof(value)) < 0) {
+    cerr << "setsockopt " << label << " failed: " << strerror(errno) << "\n";
+  }
+}
+
+optional<uint16_t> parse_port(string_view strv) {
+  unsigned value = 0;
+  auto [ptr, ec] = from_chars(strv.data(), strv.data() + strv.size(), value);
+  if (strv.empty() || ec != errc{} || ptr != strv.data() + strv.size() || value > 65535) {
+    return nullopt;
+  }
+  return value;
+}
+
+// A socket file left by an earlier run would make bind fail, so it is removed. Anything else at the
+// path, or a socket another server still accepts on, is kept and reported.
+bool remove_stale_socket(const net::Address &address) {
+  const char *path = reinterpret_cast<const sockaddr_un *>(&address.storage)->sun_path;
+  struct stat st;
+  if (lstat(path, &st) != 0) {
+    return true;
+  }
+  if (!S_ISSOCK(st.st_mode)) {
+    cerr << "Failed to bind: " << path << " exists and is not a socket\n";
+    return false;
+  }
+  int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (probe < 0) {
+    cerr << "Failed to create probe socket\n";
+    return false;
+  }
+  // A full backlog (EAGAIN) still means someone is listening
+  bool live = connect(probe, reinterpret_cast<const sockaddr *>(&address.storage), address.length) == 0 ||
+              errno == EAGAIN;
+  close(probe);
+  if (live) {
+    cerr << "Failed to bind: another server is listening on " << path << "\n";
+    return false;
+  }
+  unlink(path);
+  return true;
+}
+
+} // namespace
+
+namespace net {
+
+optional<Address> parse_address(string_view strv, uint16_t default_port) {
+  Address address{};
+  if (strv.starts_with("unix:")) {
+    auto path = strv.substr(5);
+    auto *un = reinterpret_cast<sockaddr_un *>(&address.storage);
+    if (path.empty() || path.size() >= sizeof(un->sun_path)) {
+      return nullopt;
+    }
+    un->sun_family = AF_UNIX;
+    memcpy(un->sun_path, path.data(), path.size());
+    address.length = offsetof(sockaddr_un, sun_path) + path.size() + 1;
+    return address;
+  }
+
+  string_view host = strv;
+  uint16_t port = default_port;
+  if (strv.starts_with('[')) {
+    size_t close = strv.find(']');
+    if (close == string_view::npos) {
+      return nullopt;
+    }
+    host = strv.substr(1, close - 1);
+    auto rest = strv.substr(close + 1);
+    if (!rest.empty()) {
+      auto parsed = rest.starts_with(':') ? parse_port(rest.substr(1)) : nullopt;
+      if (!parsed) {
+        return nullopt;
+      }
+      port = *parsed;
+    }
+  } else if (size_t colon = strv.rfind(':'); colon != string_view::npos) {
+    if (strv.find(':') != colon) {
+      host = strv; // bare IPv6 literal without brackets
+    } else {
+      auto parsed = parse_port(strv.substr(colon + 1));
+      if (!parsed) {
+        return nullopt;
+      }
+      host = strv.substr(0, colon);
+      port = *parsed;
+    }
+  }
+
+  string host_str = host.empty() ? "0.0.0.0" : string(host);
+  auto *in4 = reinterpret_cast<sockaddr_in *>(&address.storage);
+  if (inet_pton(AF_INET, host_str.c_str(), &in4->sin_addr) == 1) {
+    in4->sin_family = AF_INET;
+    in4->sin_port = htons(port);
+    address.length = sizeof(sockaddr_in);
+    return address;
+  }
+  auto *in6 = reinterpret_cast<sockaddr_in6 *>(&address.storage);
+  if (inet_pton(AF_INET6, host_str.c_str(), &in6->sin6_addr) == 1) {
+    in6->sin6_family = AF_INET6;
+    in6->sin6_port = htons(port);
+    address.length = sizeof(sockaddr_in6);
+    return address;
+  }
+  return nullopt;
+}
+
+string address_host(const Address &address) {
+  char buf[INET6_ADDRSTRLEN] = {0};
+  if (address.family() == AF_INET) {
+    inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in *>(&address.storage)->sin_addr, buf, sizeof(buf));
+  } else if (address.family() == AF_INET6) {
+    inet_ntop(AF_INET6, &reinterpret_cast<const sockaddr_in6 *>(&address.storage)->sin6_addr, buf, sizeof(buf));
+  }
+  return buf;
+}
+
+int bind_listener(const Address &address, const SocketOptions &options) {
+  int fd = socket(address.family(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    cerr << "Failed to create server socket\n";
+    return -1;
+  }
+
+  if (address.family() == AF_UNIX) {
+    if (!remove_stale_socket(address)) {
+      close(fd);
+      return -1;
+    }
+  } else {
+    int reuse = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0) {
+      cerr << "setsockopt failed\n";
+      close(fd);
+      return -1;
+    }
+    if (options.defer_accept > 0) {
+      set_option(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, options.defer_accept, "TCP_DEFER_ACCEPT");
+    }
+    if (options.fastopen > 0) {
+      set_option(fd, IPPROTO_TCP, TCP_FASTOPEN, options.fastopen, "TCP_FASTOPEN");
+    }
+  }
+  // Buffer sizes are inherited by accepted sockets and must be set before listen() to affect window scaling
+  if (options.receive_buffer > 0) {
+    set_option(fd, SOL_SOCKET, SO_RCVBUF, options.receive_buffer, "SO_RCVBUF");
+  }
+  if (options.send_buffer > 0) {
+    set_option(fd, SOL_SOCKET, SO_SNDBUF, options.send_buffer, "SO_SNDBUF");
+  }
+
+  if (bind(fd, reinterpret_cast<const sockaddr *>(&address.storage), address.length) != 0) {
+    cerr << "Failed to bind: " << strerror(errno) << "\n";
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+void tune_client(int fd, int family, const SocketOptions &options) {
+  if (family == AF_UNIX) {
+    return;
+  }
+  if (options.tcp_nodelay) {
+    set_option(fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+  }
+  if (options.busy_poll > 0) {
+    set_option(fd, SOL_SOCKET, SO_BUSY_POLL, options.busy_poll, "SO_BUSY_POLL");
+  }
+}
+
+} // namespace net
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+
+namespace net {
+
+struct SocketOptions {
+  bool tcp_nodelay = false;
+  int defer_accept = 0;  // seconds the kernel may hold a connection until data arrives (TCP_DEFER_ACCEPT)
+  int fastopen = 0;      // TCP_FASTOPEN queue length
+  int receive_buffer = 0; // SO_RCVBUF bytes, 0 keeps the kernel default
+  int send_buffer = 0;    // SO_SNDBUF bytes, 0 keeps the kernel default
+  int busy_poll = 0;      // SO_BUSY_POLL microseconds
+};
+
+struct Address {
+  sockaddr_storage storage;
+  socklen_t length;
+
+  int family() const { return storage.ss_family; }
+};
+
+// Accepts `host:port`, `[v6-host]:port`, `:port`, `host` (with `default_port`) and `unix:/path`
+std::optional<Address> parse_address(std::string_view strv, uint16_t default_port);
+// Numeric host of an accepted peer, empty for Unix domain sockets
+std::string address_host(const Address &address);
+
+// Creates, tunes and binds a listening socket; returns -1 (after logging) on failure
+int bind_listener(const Address &address, const SocketOptions &options);
+// Per-connection options that are not inherited from the listener
+void tune_client(int fd, int family, const SocketOptions &options);
+
+} // namespace net
@@ -0,0 +1,212 @@
+#include "tls.h"
+
+#include <cerrno>
+#include <iostream>
+
+#ifdef HTTP_SERVER_TLS
+
+#include <algorithm>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t MAX_RECORD = 16 * 1024;
+constexpr unsigned char SESSION_ID_CONTEXT[] = "http-server-cpp";
+
+void log_openssl_error(const char *what) {
+  char buf[256];
+  ERR_error_string_n(ERR_get_error(), buf, sizeof(buf));
+  std::cerr << what << ": " << buf << "\n";
+  ERR_clear_error();
+}
+
+// Staging for small writes and the user-space file path. A retried write rebuilds the same bytes,
+// which SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER permits at a different address.
+char *staging() {
+  thread_local char buf[MAX_RECORD];
+  return buf;
+}
+
+} // namespace
+
+namespace net {
+
+TlsContext::TlsContext(const TlsOptions &options) {
+  SSL_CTX *context = SSL_CTX_new(TLS_server_method());
+  if (!context) {
+    log_openssl_error("Failed to create TLS context");
+    return;
+  }
+  SSL_CTX_set_min_proto_version(context, TLS1_2_VERSION);
+  SSL_CTX_set_mode(context, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+  // A peer closing without close_notify reads as a normal end of stream
+  SSL_CTX_set_options(context, SSL_OP_IGNORE_UNEXPECTED_EOF | (options.ktls ? SSL_OP_ENABLE_KTLS : 0));
+  SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_SERVER);
+  SSL_CTX_set_session_id_context(context, SESSION_ID_CONTEXT, sizeof(SESSION_ID_CONTEXT) - 1);
+
+  if (SSL_CTX_use_certificate_chain_file(context, options.certificate.c_str()) != 1) {
+    log_openssl_error(("Failed to load certificate " + options.certificate).c_str());
+    SSL_CTX_free(context);
+    return;
+  }
+  if (SSL_CTX_use_PrivateKey_file(context, options.private_key.c_str(), SSL_FILETYPE_PEM) != 1 ||
+      SSL_CTX_check_private_key(context) != 1) {
+    log_openssl_error(("Failed to load private key " + options.private_key).c_str());
+    SSL_CTX_free(context);
+    return;
+  }
+  ctx = context;
+}
+
+TlsContext::~TlsContext() { SSL_CTX_free(ctx); }
+
+TlsStream::TlsStream(const TlsContext &context, int fd) : ssl(SSL_new(context.native())) {
+  SSL_set_fd(ssl, fd);
+  SSL_set_accept_state(ssl);
+}
+
+TlsStream::~TlsStream() { SSL_free(ssl); }
+
+ssize_t TlsStream::fail(int ret) {
+  int error = SSL_get_error(ssl, ret);
+  ERR_clear_error();
+  switch (error) {
+  case SSL_ERROR_WANT_READ:
+    want_write = false;
+    errno = EAGAIN;
+    return -1;
+  case SSL_ERROR_WANT_WRITE:
+    want_write = true;
+    errno = EAGAIN;
+    return -1;
+  case SSL_ERROR_ZERO_RETURN:
+    return 0;
+  case SSL_ERROR_SYSCALL:
+    if (errno == 0 || errno == EAGAIN) {
+      errno = EPIPE;
+    }
+    return -1;
+  default:
+    errno = EPROTO;
+    return -1;
+  }
+}
+
+int TlsStream::handshake() {
+  ERR_clear_error();
+  int ret = SSL_do_handshake(ssl);
+  if (ret == 1) {
+    return 1;
+  }
+  if (fail(ret) == 0) {
+    errno = EPROTO;
+  }
+  return -1;
+}
+
+ssize_t TlsStream::read(char *data, size_t length) {
+  ERR_clear_error();
+  size_t n = 0;
+  int ret = SSL_read_ex(ssl, data, length, &n);
+  return ret == 1 ? static_cast<ssize_t>(n) : fail(ret);
+}
+
+ssize_t TlsStream::writev(const struct iovec *iov, int iovcnt) {
+  ssize_t total = 0;
+  int i = 0;
+  while (i < iovcnt) {
+    const char *data;
+    size_t length;
+    if (iov[i].iov_len >= MAX_RECORD) {
+      data = static_cast<const char *>(iov[i].iov_base);
+      length = iov[i].iov_len;
+      i++;
+    } else {
+      // Small pieces (head, short bodies) share one record instead of one record each
+      char *buf = staging();
+      length = 0;
+      while (i < iovcnt && length + iov[i].iov_len <= MAX_RECORD) {
+        std::copy_n(static_cast<const char *>(iov[i].iov_base), iov[i].iov_len, buf + length);
+        length += iov[i].iov_len;
+        i++;
+      }
+      data = buf;
+    }
+    ERR_clear_error();
+    size_t written = 0;
+    int ret = SSL_write_ex(ssl, data, length, &written);
+    if (ret != 1) {
+      // Report progress first; the error comes back on the next call
+      return total > 0 ? total : fail(ret);
+    }
+    total += written;
+    if (written < length) {
+      break;
+    }
+  }
+  return total;
+}
+
+ssize_t TlsStream::sendfile(int fd, off_t offset, size_t length) {
+  ERR_clear_error();
+  if (ktls_send()) {
+    ossl_ssize_t n = SSL_sendfile(ssl, fd, offset, length, 0);
+    return n >= 0 ? n : fail(-1);
+  }
+  char *buf = staging();
+  ssize_t n = pread(fd, buf, std::min(length, MAX_RECORD), offset);
+  if (n <= 0) {
+    return n;
+  }
+  size_t written = 0;
+  int ret = SSL_write_ex(ssl, buf, n, &written);
+  return ret == 1 ? static_cast<ssize_t>(written) : fail(ret);
+}
+
+void TlsStream::shutdown() {
+  if (!SSL_is_init_finished(ssl) || (SSL_get_shutdown(ssl) & SSL_SENT_SHUTDOWN)) {
+    return;
+  }
+  ERR_clear_error();
+  SSL_shutdown(ssl);
+  ERR_clear_error();
+}
+
+bool TlsStream::pending() const { return SSL_has_pending(ssl); }
+
+bool TlsStream::ktls_send() const { return BIO_get_ktls_send(SSL_get_wbio(ssl)); }
+
+bool TlsStream::resumed() const { return SSL_session_reused(ssl); }
+
+} // namespace net
+
+#else
+
+namespace net {
+
+TlsContext::TlsContext(const TlsOptions &) { std::cerr << "TLS requested, but built without OpenSSL\n"; }
+TlsContext::~TlsContext() = default;
+
+TlsStream::TlsStream(const TlsContext &, int) : ssl(nullptr) {}
+TlsStream::~TlsStream() = default;
+int TlsStream::handshake() {
+  errno = ENOTSUP;
+  return -1;
+}
+ssize_t TlsStream::read(char *, size_t) { return fail(-1); }
+ssize_t TlsStream::writev(const struct iovec *, int) { return fail(-1); }
+ssize_t TlsStream::sendfile(int, off_t, size_t) { return fail(-1); }
+void TlsStream::shutdown() {}
+bool TlsStream::pending() const { return false; }
+bool TlsStream::ktls_send() const { return false; }
+bool TlsStream::resumed() const { return false; }
+ssize_t TlsStream::fail(int) {
+  errno = ENOTSUP;
+  return -1;
+}
+
+} // namespace net
+
+#endif
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "transport.h"
+#include <string>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+struct ssl_st;
+struct ssl_ctx_st;
+
+namespace net {
+
+struct TlsOptions {
+  std::string certificate; // PEM certificate chain; TLS is off while empty
+  std::string private_key; // PEM private key
+  // Hand record encryption to the kernel (kTLS) after the handshake when the kernel supports it,
+  // so files still go out through sendfile
+  bool ktls = true;
+};
+
+// Server-wide TLS configuration: certificate, key and session resumption (a session cache for
+// TLS 1.2 session ids, tickets for TLS 1.3)
+class TlsContext {
+public:
+  explicit TlsContext(const TlsOptions &options); // logs and stays invalid on failure
+  ~TlsContext();
+  TlsContext(const TlsContext &) = delete;
+  TlsContext &operator=(const TlsContext &) = delete;
+
+  bool valid() const { return ctx != nullptr; }
+  ssl_ctx_st *native() const { return ctx; }
+
+private:
+  ssl_ctx_st *ctx = nullptr;
+};
+
+// Server side of one TLS connection on a nonblocking socket. The calls mirror their socket
+// counterparts: -1 with errno EAGAIN means wait for the socket, in the direction `wants_write()` gives.
+class TlsStream : public Transport {
+public:
+  TlsStream(const TlsContext &context, int fd);
+  ~TlsStream() override;
+  TlsStream(const TlsStream &) = delete;
+  TlsStream &operator=(const TlsStream &) = delete;
+
+  // 1 once established; -1 with EAGAIN while in progress, with EPROTO when it failed
+  int handshake();
+  ssize_t read(char *data, size_t length) override;
+  // Gathered into records of up to 16 KiB
+  ssize_t writev(const struct iovec *iov, int iovcnt) override;
+  // SSL_sendfile with kTLS, otherwise read and encrypted in user space
+  ssize_t sendfile(int fd, off_t offset, size_t length) override;
+  // Sends close_notify once, without waiting for the peer's. OpenSSL only keeps sessions of
+  // connections closed this way resumable.
+  void shutdown() override;
+
+  // Decrypted or buffered bytes that epoll will not report
+  bool pending() const override;
+  bool wants_write() const { return want_write; }
+  bool ktls_send() const;
+  bool resumed() const;
+
+private:
+  ssize_t fail(int ret);
+
+  ssl_st *ssl;
+  bool want_write = false;
+};
+
+} // namespace net
@@ -0,0 +1,65 @@
+#include "transport.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+namespace net {
+
+ssize_t LoopbackTransport::read(char *data, size_t length) {
+  if (!readable) {
+    errno = EAGAIN;
+    return -1;
+  }
+  if (chunk == script.chunks.size()) {
+    return 0;
+  }
+  const auto &bytes = script.chunks[chunk];
+  size_t n = std::min(length, bytes.size() - offset);
+  memcpy(data, bytes.data() + offset, n);
+  offset += n;
+  if (offset == bytes.size()) {
+    chunk++;
+    offset = 0;
+    readable = false;
+  }
+  return static_cast<ssize_t>(n);
+}
+
+ssize_t LoopbackTransport::writev(const struct iovec *iov, int iovcnt) {
+  if (window == 0) {
+    errno = EAGAIN;
+    return -1;
+  }
+  size_t written = 0;
+  for (int i = 0; i < iovcnt && window > 0; i++) {
+    size_t n = std::min(iov[i].iov_len, window);
+    received.append(static_cast<const char *>(iov[i].iov_base), n);
+    written += n;
+    window -= n;
+  }
+  return static_cast<ssize_t>(written);
+}
+
+ssize_t LoopbackTransport::sendfile(int fd, off_t offset, size_t length) {
+  if (window == 0) {
+    errno = EAGAIN;
+    return -1;
+  }
+  size_t mark = received.size();
+  received.resize(mark + std::min(length, window));
+  ssize_t n = pread(fd, received.data() + mark, received.size() - mark, offset);
+  received.resize(mark + std::max<ssize_t>(n, 0));
+  if (n > 0) {
+    window -= n;
+  }
+  return n;
+}
+
+void LoopbackTransport::tick() {
+  readable = true;
+  window = script.read_window;
+}
+
+} // namespace net
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <vector>
+
+namespace net {
+
+// Byte-stream I/O under a connection. Plain sockets skip this and call the syscalls directly; TLS
+// streams and in-memory loopback connections implement it. Calls mirror their socket counterparts:
+// -1 with errno EAGAIN means nothing can move until the next readiness event.
+class Transport {
+public:
+  virtual ~Transport() = default;
+
+  virtual ssize_t read(char *data, size_t length) = 0;
+  virtual ssize_t writev(const struct iovec *iov, int iovcnt) = 0;
+  virtual ssize_t sendfile(int fd, off_t offset, size_t length) = 0;
+  // Ends the stream from our side, once
+  virtual void shutdown() {}
+  // Bytes ready to read that epoll will not report
+  virtual bool pending() const { return false; }
+};
+
+// What the client side of a loopback connection does
+struct LoopbackScript {
+  // Bytes the client sends; each chunk arrives as its own readiness event, so one request can be
+  // split across chunks or several pipelined in one. EOF follows the last chunk.
+  std::vector<std::string> chunks;
+  // Bytes the client takes per writability event; small values model a slow reader
+  size_t read_window = SIZE_MAX;
+};
+
+// An in-memory connection that plays a LoopbackScript and collects what the server writes
+class LoopbackTransport : public Transport {
+public:
+  LoopbackTransport(const LoopbackScript &script, std::string &received) : script(script), received(received) {}
+
+  ssize_t read(char *data, size_t length) override;
+  ssize_t writev(const struct iovec *iov, int iovcnt) override;
+  ssize_t sendfile(int fd, off_t offset, size_t length) override;
+
+  // The next readiness event: one more chunk can be read and the write window refills
+  void tick();
+
+private:
+  const LoopbackScript &script;
+  std::string &received;
+  size_t chunk = 0;  // next chunk to deliver
+  size_t offset = 0; // bytes of it already read
+  bool readable = false;
+  size_t window = 0; // bytes the client still takes in this event
+};
+
+} // namespace net
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <cstdint>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
 namespace http {
 
@@ -15,17 +18,27 @@ struct Status {
 
 namespace status {
 
+constexpr Status SWITCHING_PROTOCOLS = {101, "Switching Protocols"};
 constexpr Status OK = {200, "OK"};
 constexpr Status BAD_REQUEST = {400, "BAD REQUEST"};
 constexpr Status CREATED = {201, "Created"};
+constexpr Status PARTIAL_CONTENT = {206, "Partial Content"};
+constexpr Status NOT_MODIFIED = {304, "Not Modified"};
 constexpr Status NOT_FOUND = {404, "Not Found"};
+constexpr Status CONTENT_TOO_LARGE = {413, "Content Too Large"};
+constexpr Status RANGE_NOT_SATISFIABLE = {416, "Range Not Satisfiable"};
+constexpr Status EXPECTATION_FAILED = {417, "Expectation Failed"};
+constexpr Status REQUEST_HEADER_FIELDS_TOO_LARGE = {431, "Request Header Fields Too Large"};
 constexpr Status INTERNAL_SERVER_ERROR = {500, "Internal Server Error"};
+constexpr Status SERVICE_UNAVAILABLE = {503, "Service Unavailable"};
 
 } // namespace status
 
 enum class Version { Http11 };
-enum class Method { Get, Post };
-enum class ParseError { MalformedRequest, MalformedRequestLine, UnsupportedMethod, MalformedPath, UnsupportedVersion, MalformedHeader };
+enum class Method { Get, Post, Head };
+// Number of Method values, for tables indexed by method; Head must stay the last enumerator
+constexpr size_t METHOD_COUNT = static_cast<size_t>(Method::Head) + 1;
+enum class ParseError { MalformedRequest, MalformedRequestLine, UnsupportedMethod, MalformedPath, UnsupportedVersion, MalformedHeader, MalformedRange, UnsatisfiableRange };
 
 struct Headers {
   std::unordered_map<std::string, std::string> data;
@@ -39,13 +52,45 @@ struct RequestLine {
   std::string version;
 };
 
+// Inclusive byte offsets, already resolved against the representation size
+struct ByteRange {
+  size_t first;
+  size_t last;
+
+  size_t length() const { return last - first + 1; }
+};
+
 using Params = std::unordered_map<std::string, std::string>;
 
+// The query component of a request target, parsed on first lookup. Keys and values are
+// percent-decoded in place in `buffer` and referenced by offset, so copies stay valid.
+struct QueryString {
+  struct Field {
+    uint32_t key;
+    uint32_t key_length;
+    uint32_t value;
+    uint32_t value_length;
+  };
+
+  bool parsed = false;
+  std::string buffer;
+  std::vector<Field> fields;
+};
+
 struct Request {
   RequestLine requestLine;
   Headers headers;
   Params params;
   std::string body;
+  mutable QueryString query_string{};
+
+  // The request target up to `?`, still percent-encoded
+  std::string_view path() const {
+    std::string_view uri = requestLine.uri;
+    return uri.substr(0, uri.find('?'));
+  }
+  // Percent-decoded value of query parameter `name`; nothing is parsed until the first call
+  std::optional<std::string_view> query(std::string_view name) const;
 };
 
 inline std::optional<Method> parse_method(std::string_view strv) {
@@ -55,6 +100,9 @@ inline std::optional<Method> parse_method(std::string_view strv) {
   if (strv == "POST") {
     return Method::Post;
   }
+  if (strv == "HEAD") {
+    return Method::Head;
+  }
   return std::nullopt;
 }
 
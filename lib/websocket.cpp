@@ -0,0 +1,361 @@
+#include "websocket.h"
+#include "config.h"
+#include "parse.h"
+#include "route.h"
+#include "session.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <memory>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+constexpr string_view HANDSHAKE_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+uint32_t rotl(uint32_t value, int bits) { return (value << bits) | (value >> (32 - bits)); }
+
+array<uint8_t, 20> sha1(string_view data) {
+  uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+  string message(data);
+  uint64_t bits = static_cast<uint64_t>(data.size()) * 8;
+  message += static_cast<char>(0x80);
+  while (message.size() % 64 != 56) {
+    message += '\0';
+  }
+  for (int i = 7; i >= 0; --i) {
+    message += static_cast<char>(bits >> (i * 8));
+  }
+  for (size_t chunk = 0; chunk < message.size(); chunk += 64) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i) {
+      const auto *p = reinterpret_cast<const uint8_t *>(message.data() + chunk + i * 4);
+      w[i] = uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3];
+    }
+    for (int i = 16; i < 80; ++i) {
+      w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; ++i) {
+      uint32_t f, k;
+      if (i < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5A827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ED9EBA1;
+      } else if (i < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8F1BBCDC;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xCA62C1D6;
+      }
+      uint32_t temp = rotl(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = rotl(b, 30);
+      b = a;
+      a = temp;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+  }
+  array<uint8_t, 20> digest;
+  for (int i = 0; i < 20; ++i) {
+    digest[i] = static_cast<uint8_t>(h[i / 4] >> (24 - (i % 4) * 8));
+  }
+  return digest;
+}
+
+string base64(const uint8_t *data, size_t length) {
+  static constexpr char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  string out;
+  out.reserve((length + 2) / 3 * 4);
+  for (size_t i = 0; i < length; i += 3) {
+    uint32_t n = uint32_t(data[i]) << 16;
+    if (i + 1 < length) {
+      n |= uint32_t(data[i + 1]) << 8;
+    }
+    if (i + 2 < length) {
+      n |= data[i + 2];
+    }
+    out += ALPHABET[(n >> 18) & 63];
+    out += ALPHABET[(n >> 12) & 63];
+    out += i + 1 < length ? ALPHABET[(n >> 6) & 63] : '=';
+    out += i + 2 < length ? ALPHABET[n & 63] : '=';
+  }
+  return out;
+}
+
+optional<string_view> header(const http::Request &request, const string &name) {
+  auto it = request.headers.data.find(name);
+  if (it == request.headers.data.end()) {
+    return nullopt;
+  }
+  return it->second;
+}
+
+// Frames are unmasked in place in the connection's input buffer. The fragments of a message are
+// moved together at the front of the unconsumed input as they arrive (over the headers and any
+// control frames between them), so the complete message is handed out as one view without a copy.
+class WebSocketSession : public net::Session {
+public:
+  explicit WebSocketSession(shared_ptr<const http::WebSocketHandlers> handlers) : handlers(std::move(handlers)) {}
+
+  void on_open(net::Output &output, net::ConnectionHandle) override {
+    if (handlers->on_open) {
+      http::WebSocket socket(output);
+      handlers->on_open(socket);
+      closing = socket.closing();
+    }
+  }
+
+  net::HandlerResult on_input(span<char> input, net::Output &output) override {
+    http::WebSocket socket(output);
+    size_t consumed = 0;
+    // While a message is fragmented, its payload so far sits at input[consumed, consumed + assembled):
+    // the start of the unconsumed input, which is offset 0 again on the next call
+    size_t pos = fragmented ? scanned : 0;
+    while (!closing) {
+      auto header = http::parse_frame_header(string_view(input.data() + pos, input.size() - pos));
+      if (!header) {
+        if (header.error() == http::FrameError::Incomplete) {
+          break;
+        }
+        return fail(socket, http::close_code::PROTOCOL_ERROR, input.size());
+      }
+      bool control = static_cast<uint8_t>(header->opcode) & 0x8;
+      // Clients must mask; control frames are short and never fragmented
+      if (!header->masked || (control && (!header->fin || header->length > 125))) {
+        return fail(socket, http::close_code::PROTOCOL_ERROR, input.size());
+      }
+      if (header->length > config::MAX_BODY_SIZE - (fragmented ? assembled : 0)) {
+        return fail(socket, http::close_code::MESSAGE_TOO_BIG, input.size());
+      }
+      size_t frame_end = pos + header->header_size + header->length;
+      if (frame_end > input.size()) {
+        break;
+      }
+      char *payload = input.data() + pos + header->header_size;
+      http::unmask(payload, header->length, header->mask);
+      string_view data(payload, header->length);
+
+      if (control) {
+        if (header->opcode == http::Opcode::Ping) {
+          write_frame(output, http::Opcode::Pong, data);
+        } else if (header->opcode == http::Opcode::Close) {
+          // Echo the status code (the first two payload bytes) and close
+          socket.close(data.size() >= 2 ? uint16_t(uint8_t(data[0])) << 8 | uint8_t(data[1]) : http::close_code::NORMAL);
+          closing = true;
+          break;
+        }
+        pos = frame_end;
+        if (!fragmented) {
+          consumed = pos;
+        }
+        continue;
+      }
+
+      if ((header->opcode == http::Opcode::Continuation) != fragmented) {
+        return fail(socket, http::close_code::PROTOCOL_ERROR, input.size());
+      }
+      if (header->opcode != http::Opcode::Continuation) {
+        binary = header->opcode == http::Opcode::Binary;
+      }
+      if (!fragmented && header->fin) {
+        deliver(socket, data);
+        consumed = pos = frame_end;
+        continue;
+      }
+      memmove(input.data() + consumed + assembled, payload, header->length);
+      assembled += header->length;
+      fragmented = true;
+      pos = frame_end;
+      if (header->fin) {
+        fragmented = false;
+        deliver(socket, string_view(input.data() + consumed, assembled));
+        assembled = 0;
+        consumed = pos;
+      }
+    }
+    if (closing || socket.closing()) {
+      closing = true;
+      return {input.size(), true};
+    }
+    scanned = pos - consumed;
+    return {consumed, false};
+  }
+
+  void on_close() override {
+    if (handlers->on_close) {
+      handlers->on_close();
+    }
+  }
+
+private:
+  void deliver(http::WebSocket &socket, string_view message) {
+    if (handlers->on_message) {
+      handlers->on_message(socket, message, binary);
+    }
+    closing = socket.closing();
+  }
+
+  net::HandlerResult fail(http::WebSocket &socket, uint16_t code, size_t all) {
+    socket.close(code);
+    closing = true;
+    return {all, true};
+  }
+
+  shared_ptr<const http::WebSocketHandlers> handlers;
+  uint32_t assembled = 0; // payload bytes of the fragmented message gathered so far
+  uint32_t scanned = 0;   // input bytes of the fragmented message parsed so far
+  bool fragmented = false;
+  bool binary = false;
+  bool closing = false;
+};
+
+} // namespace
+
+namespace http {
+
+expected<FrameHeader, FrameError> parse_frame_header(string_view strv) {
+  if (strv.size() < 2) {
+    return unexpected(FrameError::Incomplete);
+  }
+  auto b0 = static_cast<uint8_t>(strv[0]);
+  auto b1 = static_cast<uint8_t>(strv[1]);
+  FrameHeader header{};
+  header.fin = b0 & 0x80;
+  header.opcode = static_cast<Opcode>(b0 & 0x0f);
+  uint8_t op = b0 & 0x0f;
+  // No extensions are negotiated, so the reserved bits must be clear
+  if ((b0 & 0x70) || (op > 0x2 && op < 0x8) || op > 0xa) {
+    return unexpected(FrameError::ProtocolError);
+  }
+  header.masked = b1 & 0x80;
+  size_t pos = 2;
+  uint64_t length = b1 & 0x7f;
+  size_t extended = length == 126 ? 2 : length == 127 ? 8 : 0;
+  if (strv.size() < pos + extended + (header.masked ? 4 : 0)) {
+    return unexpected(FrameError::Incomplete);
+  }
+  if (extended > 0) {
+    length = 0;
+    for (size_t i = 0; i < extended; ++i) {
+      length = length << 8 | static_cast<uint8_t>(strv[pos + i]);
+    }
+    if (length >> 63) {
+      return unexpected(FrameError::ProtocolError);
+    }
+    pos += extended;
+  }
+  if (header.masked) {
+    memcpy(header.mask, strv.data() + pos, 4);
+    pos += 4;
+  }
+  header.length = length;
+  header.header_size = pos;
+  return header;
+}
+
+void unmask(char *data, size_t length, const uint8_t mask[4], size_t offset) {
+  // The key rotated so that data[0] lines up with key byte `offset % 4`
+  uint8_t key[4];
+  for (size_t i = 0; i < 4; ++i) {
+    key[i] = mask[(offset + i) % 4];
+  }
+  uint32_t key32;
+  memcpy(&key32, key, 4);
+  size_t i = 0;
+#if defined(__SSE2__)
+  __m128i key128 = _mm_set1_epi32(static_cast<int>(key32));
+  for (; i + 16 <= length; i += 16) {
+    auto *p = reinterpret_cast<__m128i *>(data + i);
+    _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), key128));
+  }
+#endif
+  uint64_t key64 = uint64_t(key32) << 32 | key32;
+  for (; i + 8 <= length; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, 8);
+    word ^= key64;
+    memcpy(data + i, &word, 8);
+  }
+  for (; i < length; ++i) {
+    data[i] ^= key[i % 4];
+  }
+}
+
+void write_frame(net::Output &out, Opcode opcode, string_view payload, bool fin) {
+  char head[10];
+  size_t n = 0;
+  head[n++] = static_cast<char>((fin ? 0x80 : 0) | static_cast<uint8_t>(opcode));
+  if (payload.size() < 126) {
+    head[n++] = static_cast<char>(payload.size());
+  } else if (payload.size() <= 0xffff) {
+    head[n++] = 126;
+    head[n++] = static_cast<char>(payload.size() >> 8);
+    head[n++] = static_cast<char>(payload.size());
+  } else {
+    head[n++] = 127;
+    for (int i = 7; i >= 0; --i) {
+      head[n++] = static_cast<char>(static_cast<uint64_t>(payload.size()) >> (i * 8));
+    }
+  }
+  size_t mark = out.buffer.size();
+  out.buffer.append(head, n);
+  out.buffer.append(payload);
+  out.commit(mark);
+}
+
+string websocket_accept(string_view key) {
+  string input(key);
+  input += HANDSHAKE_GUID;
+  auto digest = sha1(input);
+  return base64(digest.data(), digest.size());
+}
+
+void WebSocket::close(uint16_t code) {
+  if (closed) {
+    return;
+  }
+  char payload[2] = {static_cast<char>(code >> 8), static_cast<char>(code)};
+  write_frame(output, Opcode::Close, string_view(payload, 2));
+  closed = true;
+}
+
+void ws(string route, WebSocketHandlers handlers) {
+  auto shared = make_shared<const WebSocketHandlers>(std::move(handlers));
+  create_route(
+      Method::Get, std::move(route),
+      [](const Request &req, Response &res) {
+        auto upgrade = header(req, "Upgrade");
+        auto connection = header(req, "Connection");
+        auto version = header(req, "Sec-WebSocket-Version");
+        auto key = header(req, "Sec-WebSocket-Key");
+        if (req.requestLine.method != Method::Get || !upgrade || !iequals(*upgrade, "websocket") || !connection ||
+            !has_token(*connection, "upgrade") || version != "13" || !key || key->empty()) {
+          res.set_status(status::BAD_REQUEST);
+          return;
+        }
+        res.set_status(status::SWITCHING_PROTOCOLS);
+        res.headers.set("Upgrade", "websocket");
+        res.headers.set("Connection", "Upgrade");
+        res.headers.set("Sec-WebSocket-Accept", websocket_accept(*key));
+      },
+      {.upgrade = [shared](const Request &) -> unique_ptr<net::Session> {
+        return make_unique<WebSocketSession>(shared);
+      }});
+}
+
+} // namespace http
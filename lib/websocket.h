@@ -0,0 +1,69 @@
+#pragma once
+
+#include "output.h"
+#include "types.h"
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace http {
+
+enum class Opcode : uint8_t { Continuation = 0x0, Text = 0x1, Binary = 0x2, Close = 0x8, Ping = 0x9, Pong = 0xa };
+
+// Close codes used by the server (RFC 6455 7.4.1)
+namespace close_code {
+constexpr uint16_t NORMAL = 1000;
+constexpr uint16_t PROTOCOL_ERROR = 1002;
+constexpr uint16_t MESSAGE_TOO_BIG = 1009;
+} // namespace close_code
+
+struct FrameHeader {
+  bool fin;
+  Opcode opcode;
+  bool masked;
+  uint8_t mask[4];
+  uint64_t length;    // payload bytes
+  size_t header_size; // bytes before the payload
+};
+
+enum class FrameError { Incomplete, ProtocolError };
+
+std::expected<FrameHeader, FrameError> parse_frame_header(std::string_view strv);
+// XORs `data` with the masking key, as if `data` started `offset` bytes into the payload.
+// 16 bytes per step with SSE2, 8 with a machine word otherwise.
+void unmask(char *data, size_t length, const uint8_t mask[4], size_t offset = 0);
+// Queues one unmasked (server-to-client) frame
+void write_frame(net::Output &out, Opcode opcode, std::string_view payload, bool fin = true);
+// `Sec-WebSocket-Accept` for a client's `Sec-WebSocket-Key`
+std::string websocket_accept(std::string_view key);
+
+// The server end of an open WebSocket, handed to the handlers
+class WebSocket {
+public:
+  explicit WebSocket(net::Output &output) : output(output) {}
+
+  void send_text(std::string_view message) { write_frame(output, Opcode::Text, message); }
+  void send_binary(std::string_view message) { write_frame(output, Opcode::Binary, message); }
+  // Starts the closing handshake; the connection closes once the frame is written
+  void close(uint16_t code = close_code::NORMAL);
+  bool closing() const { return closed; }
+
+private:
+  net::Output &output;
+  bool closed = false;
+};
+
+struct WebSocketHandlers {
+  std::function<void(WebSocket &)> on_open;
+  // `message` is reassembled from all its fragments and valid only during the call
+  std::function<void(WebSocket &, std::string_view message, bool binary)> on_message;
+  std::function<void()> on_close;
+};
+
+// Registers a WebSocket endpoint: GET requests with a valid upgrade handshake are answered with 101
+// and the connection switches to WebSocket frames; anything else gets 400
+void ws(std::string route, WebSocketHandlers handlers);
+
+} // namespace http
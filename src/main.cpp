@@ -1,60 +1,265 @@
+#include <access_log.h>
+#include <assets.h>
+#include <cache.h>
 #include <config.h>
+#include <event_stream.h>
+#include <http2.h>
+#include <middleware.h>
 #include <parse.h>
 #include <response.h>
 #include <route.h>
 #include <server.h>
+#include <websocket.h>
 
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
+
+namespace {
+
+constexpr std::string_view CONTINUE = "HTTP/1.1 100 Continue\r\n\r\n";
+
+// A non-negative number filling the whole argument
+template <typename T> std::optional<T> parse_number(std::string_view strv) {
+  T value{};
+  auto [ptr, ec] = std::from_chars(strv.data(), strv.data() + strv.size(), value);
+  if (strv.empty() || ec != std::errc{} || ptr != strv.data() + strv.size() || value < 0) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+void log_access(http::AccessLog &log, const net::RequestContext &context, const http::Request *request,
+                uint16_t status, size_t bytes) {
+  auto now = std::chrono::steady_clock::now();
+  http::AccessRecord record;
+  record.time = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::system_clock::now().time_since_epoch())
+                    .count();
+  record.bytes = bytes;
+  record.latency =
+      static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - context.received).count());
+  record.status = status;
+  record.peer = context.peer;
+  if (request) {
+    record.method = static_cast<uint8_t>(request->requestLine.method);
+    record.set_path(request->path());
+  } else {
+    record.set_path("-");
+  }
+  log.record(record);
+}
+
+// Answers with `status` and closes; whatever else the client sends is never read
+net::HandlerResult reject(http::Status status, std::string_view input, net::Output &out,
+                          const net::RequestContext &context, http::AccessLog *log,
+                          const http::Request *request = nullptr) {
+  size_t queued = out.size();
+  http::Response response{};
+  response.set_status(status);
+  response.headers.set("Connection", "close");
+  response.write_to(out);
+  if (log) {
+    log_access(*log, context, request, status.code, out.size() - queued);
+  }
+  return {input.size(), true};
+}
+
+// The message is incomplete. Once its head is in, the route and limits are checked so doomed uploads
+// are refused before the body is sent; otherwise `Expect: 100-continue` clients are told to go ahead.
+// The server remembers a head that passed, so later reads of the body skip all of this.
+net::HandlerResult await_body(std::string_view input, net::Output &out, const net::RequestContext &context,
+                              http::AccessLog *log) {
+  if (context.head_checked) {
+    return {0, false, nullptr, true};
+  }
+  size_t head_end = input.find("\r\n\r\n");
+  if (head_end == std::string_view::npos) {
+    if (input.size() > config::MAX_HEADER_SIZE) {
+      return reject(http::status::REQUEST_HEADER_FIELDS_TOO_LARGE, input, out, context, log);
+    }
+    return {0, false};
+  }
+  if (head_end > config::MAX_HEADER_SIZE) {
+    return reject(http::status::REQUEST_HEADER_FIELDS_TOO_LARGE, input, out, context, log);
+  }
+  auto request = http::parse_request(input.substr(0, head_end + 4));
+  if (!request) {
+    return reject(http::status::BAD_REQUEST, input, out, context, log);
+  }
+  if (auto status = http::check_request_head(*request)) {
+    return reject(*status, input, out, context, log, &*request);
+  }
+  auto expect = request->headers.data.find("Expect");
+  // Only before any body bytes arrived: the server re-invokes the handler only when new input came in
+  if (expect != request->headers.data.end() && input.size() == head_end + 4) {
+    out.append(CONTINUE);
+  }
+  return {0, false, nullptr, true};
+}
+
+} // namespace
 
 int main(int argc, char *argv[]) {
   std::cout << std::unitbuf;
   std::cerr << std::unitbuf;
 
-  for (int i = 1; i < argc - 1; ++i) {
-    if (std::string(argv[i]) == "--directory") {
-      config::directory = argv[i + 1];
+  net::Options options;
+  std::string access_log_path;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto number = [&](auto &target) {
+      std::string_view value = argv[++i];
+      auto parsed = parse_number<std::remove_reference_t<decltype(target)>>(value);
+      if (!parsed) {
+        std::cerr << "invalid value for " << arg << ": " << value << "\n";
+        std::exit(1);
+      }
+      target = *parsed;
+    };
+    if (arg == "--directory" && i + 1 < argc) {
+      config::directory = argv[++i];
+    } else if (arg == "--edge-triggered") {
+      options.edge_triggered = true;
+    } else if (arg == "--listen" && i + 1 < argc) {
+      options.address = argv[++i];
+    } else if (arg == "--tcp-nodelay") {
+      options.socket.tcp_nodelay = true;
+    } else if (arg == "--defer-accept" && i + 1 < argc) {
+      number(options.socket.defer_accept);
+    } else if (arg == "--fastopen" && i + 1 < argc) {
+      number(options.socket.fastopen);
+    } else if (arg == "--rcvbuf" && i + 1 < argc) {
+      number(options.socket.receive_buffer);
+    } else if (arg == "--sndbuf" && i + 1 < argc) {
+      number(options.socket.send_buffer);
+    } else if (arg == "--busy-poll" && i + 1 < argc) {
+      number(options.socket.busy_poll);
+    } else if (arg == "--rate-limit" && i + 1 < argc) {
+      number(options.admission.rate);
+    } else if (arg == "--burst" && i + 1 < argc) {
+      number(options.admission.burst);
+    } else if (arg == "--max-concurrency" && i + 1 < argc) {
+      number(options.admission.max_concurrency);
+    } else if (arg == "--tls-cert" && i + 1 < argc) {
+      options.tls.certificate = argv[++i];
+    } else if (arg == "--tls-key" && i + 1 < argc) {
+      options.tls.private_key = argv[++i];
+    } else if (arg == "--no-ktls") {
+      options.tls.ktls = false;
+    } else if (arg == "--access-log" && i + 1 < argc) {
+      access_log_path = argv[++i];
     }
   }
 
   http::get("/", [](const http::Request &req, http::Response &res) {});
-  http::get("/echo/:content", [](const http::Request &req, http::Response &res) {
-    res.send(req.params.at("content"));
-  });
-  http::get("/user-agent", [](const http::Request &req, http::Response &res) {
-    res.send(req.headers.data.at("User-Agent"));
-  });
+  http::get(
+      "/echo/:content", [](const http::Request &req, http::Response &res) { res.send(req.params.at("content")); },
+      {.cache = http::CachePolicy{std::chrono::seconds(60), {}}});
+  http::get(
+      "/user-agent", [](const http::Request &req, http::Response &res) { res.send(req.headers.data.at("User-Agent")); },
+      {.cache = http::CachePolicy{std::chrono::seconds(60), {"User-Agent"}}});
   http::get("/files/:filename", [](const http::Request &req, http::Response &res) {
-    res.send_file(config::directory + "/" + req.params.at("filename"));
+    res.send_file(config::directory + "/" + req.params.at("filename"), req);
+  });
+  http::get("/static/:name", [](const http::Request &req, http::Response &res) {
+    if (const auto *asset = http::find_asset(req.params.at("name"))) {
+      res.send_asset(*asset, req);
+    } else {
+      res.set_status(http::status::NOT_FOUND);
+    }
   });
-  http::post("/files/:filename", [](const http::Request &req, http::Response &res) {
-    std::string path = config::directory + "/" + req.params.at("filename");
-    std::ofstream file(path, std::ios::binary);
-    file << req.body;
+  http::ws("/ws/echo", {.on_message = [](http::WebSocket &socket, std::string_view message, bool binary) {
+              binary ? socket.send_binary(message) : socket.send_text(message);
+            }});
+  http::EventStream events;
+  http::sse("/events", events);
+  http::post("/events", [events](const http::Request &req, http::Response &res) mutable {
+    events.publish({req.body});
   });
+  http::post(
+      "/files/:filename",
+      [](const http::Request &req, http::Response &res) {
+        std::string path = config::directory + "/" + req.params.at("filename");
+        std::ofstream file(path, std::ios::binary);
+        file << req.body;
+      },
+      {.precondition = [](const http::Request &) -> std::optional<http::Status> {
+        std::error_code ec;
+        if (!std::filesystem::is_directory(config::directory, ec)) {
+          return http::status::NOT_FOUND;
+        }
+        return std::nullopt;
+      }});
 
-  net::Server server(config::PORT);
-  server.listen([](const std::string &raw) -> net::HandlerResult {
-    auto request = http::parse_request(raw);
+  http::ResponseCache cache(config::CACHE_CAPACITY);
+  std::unique_ptr<http::AccessLog> access_log;
+  if (!access_log_path.empty()) {
+    access_log = std::make_unique<http::AccessLog>(access_log_path);
+  }
+  http::StreamLog log_stream;
+  if (access_log) {
+    log_stream = [log = access_log.get()](const net::RequestContext &context, const http::Request *request,
+                                          uint16_t status, size_t bytes) {
+      log_access(*log, context, request, status, bytes);
+    };
+  }
+  // HTTP/2 streams skip KeepAlive and Cache: both deal in HTTP/1.1 connections and bytes
+  http::Pipeline h2_pipeline(http::HeadMethod{}, http::Gzip{});
+  http::Serve serve_h2 = [&h2_pipeline](http::Exchange &exchange) { h2_pipeline(exchange, http::dispatch); };
+  http::Pipeline pipeline(http::KeepAlive{}, http::H2cUpgrade{serve_h2, log_stream}, http::Cache{cache},
+                          http::HeadMethod{}, http::Gzip{});
+
+  if (access_log) {
+    options.on_reject = [log = access_log.get()](const net::RequestContext &context, uint16_t status, size_t bytes) {
+      log_access(*log, context, nullptr, status, bytes);
+    };
+  }
+  net::Server server(config::PORT, options);
+  server.listen([&pipeline, &serve_h2, &log_stream, log = access_log.get()](
+                    std::string_view input, net::Output &out,
+                    const net::RequestContext &context) -> net::HandlerResult {
+    // HTTP/2 with prior knowledge
+    if (input.starts_with(http::HTTP2_PREFACE)) {
+      return {http::HTTP2_PREFACE.size(), false, http::http2_session(serve_h2, log_stream)};
+    }
+    if (http::HTTP2_PREFACE.starts_with(input)) {
+      return {0, false};
+    }
+    auto length = http::message_length(input);
+    if (!length) {
+      return await_body(input, out, context, log);
+    }
+    size_t consumed = *length;
+    size_t queued = log ? out.size() : 0;
+    auto request = http::parse_request(input.substr(0, consumed));
     http::Response response{};
     if (!request) {
       response.set_status(http::status::BAD_REQUEST);
-      return {response.to_str(), true};
-    }
-    auto handler = http::get_route_handler(*request);
-    if (handler) {
-      (*handler)(*request, response);
+      response.write_to(out);
+      if (log) {
+        log_access(*log, context, nullptr, http::status::BAD_REQUEST.code, out.size() - queued);
+      }
+      return {input.size(), true};
     }
-    auto ae = request->headers.data.find("Accept-Encoding");
-    if (ae != request->headers.data.end() && ae->second.find("gzip") != std::string::npos) {
-      response.encode_gzip();
+    http::Exchange exchange{*request, response};
+    exchange.head_checked = context.head_checked;
+    pipeline(exchange, http::dispatch);
+    if (exchange.serialized) {
+      http::write_cached(out, std::move(exchange.serialized));
+    } else {
+      response.write_to(out);
     }
-    auto conn = request->headers.data.find("Connection");
-    bool should_close = conn != request->headers.data.end() && conn->second == "close";
-    if (should_close) {
-      response.headers.set("Connection", "close");
+    if (log) {
+      // Only 200s are cached, so serialized responses are always OK
+      auto status = exchange.serialized ? http::status::OK : response.responseLine.status;
+      log_access(*log, context, &*request, status.code, out.size() - queued);
     }
-    return {response.to_str(), should_close};
+    return {consumed, exchange.close_connection, std::move(exchange.upgrade)};
   });
 
   return 0;
@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "../lib/access_log.h"
+#include "../lib/types.h"
+
+using namespace http;
+
+namespace {
+
+AccessRecord make_record(std::string_view path, uint16_t status = 200) {
+  AccessRecord record;
+  record.time = 1700000000123456;
+  record.bytes = 42;
+  record.latency = 7;
+  record.status = status;
+  record.method = static_cast<uint8_t>(Method::Get);
+  record.peer = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff, 127, 0, 0, 1};
+  record.set_path(path);
+  return record;
+}
+
+std::string read_file(const std::filesystem::path &path) {
+  std::ifstream file(path);
+  std::stringstream ss;
+  ss << file.rdbuf();
+  return ss.str();
+}
+
+} // namespace
+
+class AccessRingTest : public ::testing::Test {};
+
+TEST_F(AccessRingTest, PopsInOrder) {
+  AccessRing ring(4);
+  EXPECT_TRUE(ring.push(make_record("/a")));
+  EXPECT_TRUE(ring.push(make_record("/b")));
+  AccessRecord out[4];
+  ASSERT_EQ(ring.pop(out, 4), 2);
+  EXPECT_EQ(std::string_view(out[0].path, out[0].path_length), "/a");
+  EXPECT_EQ(std::string_view(out[1].path, out[1].path_length), "/b");
+  EXPECT_EQ(ring.pop(out, 4), 0);
+}
+
+TEST_F(AccessRingTest, FullRingDropsAndCounts) {
+  AccessRing ring(2);
+  EXPECT_TRUE(ring.push(make_record("/1")));
+  EXPECT_TRUE(ring.push(make_record("/2")));
+  EXPECT_FALSE(ring.push(make_record("/3")));
+  EXPECT_EQ(ring.take_dropped(), 1);
+  EXPECT_EQ(ring.take_dropped(), 0);
+
+  AccessRecord out[2];
+  ASSERT_EQ(ring.pop(out, 1), 1);
+  EXPECT_TRUE(ring.push(make_record("/4")));
+}
+
+TEST_F(AccessRingTest, LongPathsAreTruncated) {
+  auto record = make_record(std::string(500, 'x'));
+  EXPECT_EQ(record.path_length, sizeof(record.path));
+}
+
+class AccessLogTest : public ::testing::Test {};
+
+TEST_F(AccessLogTest, WritesOneLinePerRecord) {
+  auto path = std::filesystem::temp_directory_path() / "access_log_test_lines.log";
+  std::filesystem::remove(path);
+  {
+    AccessLog log(path.string());
+    ASSERT_TRUE(log.is_open());
+    log.record(make_record("/echo/abc"));
+    auto failed = make_record("-", 400);
+    failed.method = AccessRecord::NO_METHOD;
+    log.record(failed);
+  }
+  EXPECT_EQ(read_file(path), "2023-11-14T22:13:20.123456Z 127.0.0.1 GET /echo/abc 200 42 7\n"
+                             "2023-11-14T22:13:20.123456Z 127.0.0.1 - - 400 42 7\n");
+  std::filesystem::remove(path);
+}
+
+TEST_F(AccessLogTest, EachThreadGetsItsOwnRing) {
+  auto path = std::filesystem::temp_directory_path() / "access_log_test_threads.log";
+  std::filesystem::remove(path);
+  {
+    AccessLog log(path.string(), 1024);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([&log] {
+        for (int i = 0; i < 100; ++i) {
+          log.record(make_record("/thread"));
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+  auto contents = read_file(path);
+  EXPECT_EQ(std::count(contents.begin(), contents.end(), '\n'), 400);
+  std::filesystem::remove(path);
+}
+
+TEST_F(AccessLogTest, OverflowIsReportedNotBlocking) {
+  auto path = std::filesystem::temp_directory_path() / "access_log_test_drops.log";
+  std::filesystem::remove(path);
+  {
+    AccessLog log(path.string(), 2);
+    for (int i = 0; i < 10000; ++i) {
+      log.record(make_record("/burst"));
+    }
+  }
+  auto contents = read_file(path);
+  size_t lines = std::count(contents.begin(), contents.end(), '\n');
+  EXPECT_NE(contents.find("# dropped "), std::string::npos);
+  EXPECT_LT(lines, 10000);
+  std::filesystem::remove(path);
+}
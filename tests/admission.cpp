@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+
+#include <netinet/in.h>
+
+#include "../lib/admission.h"
+#include "../lib/config.h"
+
+using namespace net;
+using namespace std::chrono_literals;
+
+namespace {
+PeerKey ipv4(uint32_t host_order) {
+  sockaddr_storage storage{};
+  auto *in4 = reinterpret_cast<sockaddr_in *>(&storage);
+  in4->sin_family = AF_INET;
+  in4->sin_addr.s_addr = htonl(host_order);
+  return peer_key(storage);
+}
+
+PeerKey ipv6(uint64_t prefix, uint64_t interface) {
+  sockaddr_storage storage{};
+  auto *in6 = reinterpret_cast<sockaddr_in6 *>(&storage);
+  in6->sin6_family = AF_INET6;
+  for (int i = 0; i < 8; i++) {
+    in6->sin6_addr.s6_addr[i] = static_cast<uint8_t>(prefix >> (56 - 8 * i));
+    in6->sin6_addr.s6_addr[8 + i] = static_cast<uint8_t>(interface >> (56 - 8 * i));
+  }
+  return peer_key(storage);
+}
+} // namespace
+
+class AdmissionTest : public ::testing::Test {};
+
+TEST_F(AdmissionTest, DisabledByDefault) {
+  Admission admission;
+  EXPECT_FALSE(admission.enabled());
+}
+
+TEST_F(AdmissionTest, TokenBucketLimitsEachClient) {
+  Admission admission({.rate = 1, .burst = 2});
+  auto t0 = Admission::Clock::now();
+  auto a = ipv4(0x7f000001);
+  auto b = ipv4(0x7f000002);
+
+  EXPECT_TRUE(admission.admit_request(a, 0, 0s, t0));
+  EXPECT_TRUE(admission.admit_request(a, 0, 0s, t0));
+  EXPECT_FALSE(admission.admit_request(a, 0, 0s, t0));
+  EXPECT_FALSE(admission.admit_connection(a, t0));
+  EXPECT_TRUE(admission.admit_request(b, 0, 0s, t0));
+
+  // One token per second refills the bucket
+  EXPECT_TRUE(admission.admit_connection(a, t0 + 1s));
+  EXPECT_TRUE(admission.admit_request(a, 0, 0s, t0 + 1s));
+  EXPECT_FALSE(admission.admit_request(a, 0, 0s, t0 + 1s));
+}
+
+TEST_F(AdmissionTest, ForgetsTheLeastRecentlySeenClient) {
+  Admission admission({.rate = 1, .burst = 1});
+  auto t0 = Admission::Clock::now();
+  auto drained = ipv4(0x0a000000);
+  ASSERT_TRUE(admission.admit_request(drained, 0, 0s, t0));
+  for (uint32_t i = 1; i < config::MAX_TRACKED_CLIENTS; i++) {
+    admission.admit_connection(ipv4(0x0a000000 + i), t0);
+  }
+  // Seen again, so it is not the one forgotten when the next client arrives
+  EXPECT_FALSE(admission.admit_connection(drained, t0));
+  EXPECT_TRUE(admission.admit_connection(ipv4(0x0b000000), t0));
+  EXPECT_FALSE(admission.admit_request(drained, 0, 0s, t0));
+
+  // The client seen longest ago starts over with a full bucket
+  ASSERT_TRUE(admission.admit_request(ipv4(0x0a000002), 0, 0s, t0));
+  for (uint32_t i = 0; i < config::MAX_TRACKED_CLIENTS; i++) {
+    admission.admit_connection(ipv4(0x0c000000 + i), t0);
+  }
+  EXPECT_TRUE(admission.admit_request(ipv4(0x0a000002), 0, 0s, t0));
+}
+
+TEST_F(AdmissionTest, IPv6ClientsShareABucketPerSlash64) {
+  Admission admission({.rate = 1, .burst = 1});
+  auto t0 = Admission::Clock::now();
+  EXPECT_TRUE(admission.admit_request(ipv6(0x20010db800000001, 1), 0, 0s, t0));
+  EXPECT_FALSE(admission.admit_request(ipv6(0x20010db800000001, 2), 0, 0s, t0));
+  EXPECT_TRUE(admission.admit_request(ipv6(0x20010db800000002, 1), 0, 0s, t0));
+}
+
+TEST_F(AdmissionTest, ConcurrencyLimitShedsExcess) {
+  Admission admission({.max_concurrency = 8, .min_concurrency = 2});
+  auto t0 = Admission::Clock::now();
+  EXPECT_TRUE(admission.admit_request({}, 7, 0s, t0));
+  EXPECT_FALSE(admission.admit_request({}, 8, 0s, t0));
+}
+
+TEST_F(AdmissionTest, StandingQueueShrinksLimit) {
+  Admission admission({.max_concurrency = 100, .min_concurrency = 10, .target_delay = 5ms, .interval = 100ms});
+  auto now = Admission::Clock::now();
+  admission.admit_request({}, 0, 20ms, now);
+  for (int i = 0; i < 30; i++) {
+    now += 100ms;
+    admission.admit_request({}, 0, 20ms, now);
+  }
+  EXPECT_EQ(admission.limit(), 10);
+
+  // Once the queue drains the limit recovers additively
+  for (int i = 0; i < 5; i++) {
+    now += 100ms;
+    admission.admit_request({}, 0, 1ms, now);
+  }
+  EXPECT_EQ(admission.limit(), 15);
+}
+
+TEST_F(AdmissionTest, TransientDelayDoesNotShrinkLimit) {
+  Admission admission({.max_concurrency = 100, .target_delay = 5ms, .interval = 100ms});
+  auto now = Admission::Clock::now();
+  admission.admit_request({}, 0, 0ms, now);
+  for (int i = 0; i < 10; i++) {
+    now += 50ms;
+    admission.admit_request({}, 0, 50ms, now);
+    admission.admit_request({}, 0, 1ms, now);
+  }
+  EXPECT_EQ(admission.limit(), 100);
+}
+
+TEST_F(AdmissionTest, OverloadResponseIsComplete503) {
+  auto response = Admission::overload_response();
+  EXPECT_TRUE(response.starts_with("HTTP/1.1 503 Service Unavailable\r\n"));
+  EXPECT_NE(response.find("Retry-After: "), std::string_view::npos);
+  EXPECT_TRUE(response.ends_with("\r\n\r\n"));
+}
@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+#include <zlib.h>
+
+#include "../lib/assets.h"
+#include "../lib/response.h"
+
+using namespace http;
+
+namespace {
+
+std::string gunzip(std::string_view data) {
+  z_stream zs{};
+  inflateInit2(&zs, 15 + 16);
+  zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+  zs.avail_in = data.size();
+
+  std::string decompressed;
+  char buf[4096];
+  do {
+    zs.next_out = reinterpret_cast<Bytef *>(buf);
+    zs.avail_out = sizeof(buf);
+    inflate(&zs, Z_FINISH);
+    decompressed.append(buf, sizeof(buf) - zs.avail_out);
+  } while (zs.avail_out == 0);
+  inflateEnd(&zs);
+  return decompressed;
+}
+
+} // namespace
+
+class AssetsTest : public ::testing::Test {};
+
+TEST_F(AssetsTest, FindsEmbeddedFiles) {
+  const auto *index = find_asset("index.html");
+  ASSERT_NE(index, nullptr);
+  EXPECT_EQ(index->content_type, "text/html; charset=utf-8");
+  EXPECT_TRUE(index->data.starts_with("<!doctype html>"));
+  EXPECT_TRUE(index->etag.starts_with('"') && index->etag.ends_with('"'));
+  EXPECT_EQ(find_asset("missing.html"), nullptr);
+}
+
+TEST_F(AssetsTest, GzipVariantMatchesData) {
+  for (const auto &asset : embedded_assets()) {
+    if (!asset.gzip.empty()) {
+      EXPECT_LT(asset.gzip.size(), asset.data.size());
+      EXPECT_EQ(gunzip(asset.gzip), asset.data);
+    }
+  }
+}
+
+TEST_F(AssetsTest, SendAssetPicksEncoding) {
+  const auto &asset = *find_asset("index.html");
+  Request req{};
+  req.headers.set("Accept-Encoding", "gzip");
+  Response res{};
+  res.send_asset(asset, req);
+
+  EXPECT_EQ(res.responseLine.status.code, status::OK.code);
+  EXPECT_EQ(res.static_body.data(), asset.gzip.data());
+  EXPECT_EQ(res.headers.data.at("Content-Encoding"), "gzip");
+  EXPECT_EQ(res.headers.data.at("Content-Length"), std::to_string(asset.gzip.size()));
+
+  Response identity{};
+  identity.send_asset(asset, Request{});
+  EXPECT_EQ(identity.static_body.data(), asset.data.data());
+  EXPECT_FALSE(identity.headers.data.contains("Content-Encoding"));
+}
+
+TEST_F(AssetsTest, SendAssetHonorsIfNoneMatch) {
+  const auto &asset = *find_asset("index.html");
+  Request req{};
+  req.headers.set("Accept-Encoding", "gzip");
+  Response first{};
+  first.send_asset(asset, req);
+
+  req.headers.set("If-None-Match", first.headers.data.at("ETag"));
+  Response res{};
+  res.send_asset(asset, req);
+  EXPECT_EQ(res.responseLine.status.code, status::NOT_MODIFIED.code);
+  EXPECT_TRUE(res.static_body.empty());
+}
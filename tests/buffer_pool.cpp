@@ -0,0 +1,45 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+
+#include "../lib/buffer_pool.h"
+
+using namespace net;
+
+class BufferPoolTest : public ::testing::Test {};
+
+TEST_F(BufferPoolTest, AcquireRoundsUpToSizeClass) {
+  BufferPool pool;
+  auto buffer = pool.acquire(5000);
+  ASSERT_TRUE(buffer);
+  EXPECT_EQ(buffer.capacity, 16 << 10);
+  pool.release(buffer);
+  EXPECT_FALSE(buffer);
+}
+
+TEST_F(BufferPoolTest, AcquireFailsAboveLargestClass) {
+  BufferPool pool;
+  EXPECT_FALSE(pool.acquire(BufferPool::SIZE_CLASSES.back() + 1));
+}
+
+TEST_F(BufferPoolTest, ReleasedBufferIsReused) {
+  BufferPool pool;
+  auto first = pool.acquire(100);
+  char *data = first.data;
+  pool.release(first);
+
+  auto second = pool.acquire(100);
+  EXPECT_EQ(second.data, data);
+  pool.release(second);
+}
+
+TEST_F(BufferPoolTest, GrowKeepsContents) {
+  BufferPool pool;
+  auto buffer = pool.acquire(4096);
+  memcpy(buffer.data, "partial", 7);
+
+  ASSERT_TRUE(pool.grow(buffer, 7, buffer.capacity + 1));
+  EXPECT_EQ(buffer.capacity, 16 << 10);
+  EXPECT_EQ(std::string(buffer.data, 7), "partial");
+  pool.release(buffer);
+}
@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+
+#include "../lib/cache.h"
+
+using namespace http;
+using namespace std::chrono_literals;
+
+namespace {
+Request make_request(const std::string &uri, Headers headers = {}) {
+  return Request{{Method::Get, uri, "HTTP/1.1"}, std::move(headers), {}, {}};
+}
+} // namespace
+
+class ResponseCacheTest : public ::testing::Test {};
+
+TEST_F(ResponseCacheTest, MissOnEmptyCache) {
+  ResponseCache cache(16);
+  EXPECT_EQ(cache.lookup(make_request("/echo/a"), ""), nullptr);
+}
+
+TEST_F(ResponseCacheTest, HitReturnsStoredBytes) {
+  ResponseCache cache(16);
+  auto req = make_request("/echo/a");
+  cache.store(req, "", {60s, {}}, "HTTP/1.1 200 OK\r\n\r\na");
+
+  auto hit = cache.lookup(req, "");
+  ASSERT_NE(hit, nullptr);
+  EXPECT_EQ(*hit, "HTTP/1.1 200 OK\r\n\r\na");
+}
+
+TEST_F(ResponseCacheTest, EncodingSelectsVariant) {
+  ResponseCache cache(16);
+  auto req = make_request("/echo/a");
+  cache.store(req, "", {60s, {}}, "plain");
+  cache.store(req, "gzip", {60s, {}}, "compressed");
+
+  EXPECT_EQ(*cache.lookup(req, ""), "plain");
+  EXPECT_EQ(*cache.lookup(req, "gzip"), "compressed");
+}
+
+TEST_F(ResponseCacheTest, VaryHeaderSelectsVariant) {
+  ResponseCache cache(16);
+  Headers curl;
+  curl.set("User-Agent", "curl");
+  Headers wget;
+  wget.set("User-Agent", "wget");
+  cache.store(make_request("/user-agent", curl), "", {60s, {"User-Agent"}}, "curl");
+
+  EXPECT_EQ(*cache.lookup(make_request("/user-agent", curl), ""), "curl");
+  EXPECT_EQ(cache.lookup(make_request("/user-agent", wget), ""), nullptr);
+}
+
+TEST_F(ResponseCacheTest, ExpiredEntryMisses) {
+  ResponseCache cache(16);
+  auto req = make_request("/echo/a");
+  cache.store(req, "", {0ms, {}}, "stale");
+  EXPECT_EQ(cache.lookup(req, ""), nullptr);
+}
+
+TEST_F(ResponseCacheTest, EvictsLeastRecentlyUsed) {
+  ResponseCache cache(2, 1);
+  auto a = make_request("/a");
+  auto b = make_request("/b");
+  auto c = make_request("/c");
+  cache.store(a, "", {60s, {}}, "a");
+  cache.store(b, "", {60s, {}}, "b");
+  cache.lookup(a, "");
+  cache.store(c, "", {60s, {}}, "c");
+
+  EXPECT_NE(cache.lookup(a, ""), nullptr);
+  EXPECT_EQ(cache.lookup(b, ""), nullptr);
+  EXPECT_NE(cache.lookup(c, ""), nullptr);
+}
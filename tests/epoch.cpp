@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+
+#include "../lib/epoch.h"
+
+using namespace http;
+
+class EpochTest : public ::testing::Test {};
+
+TEST_F(EpochTest, UnpinnedRetireFreesImmediately) {
+  EpochDomain domain;
+  bool freed = false;
+  domain.retire([&freed] { freed = true; });
+  EXPECT_TRUE(freed);
+  EXPECT_EQ(domain.pending(), 0);
+}
+
+TEST_F(EpochTest, PinnedReaderDelaysFree) {
+  EpochDomain domain;
+  bool freed = false;
+  {
+    EpochDomain::Guard guard(domain);
+    domain.retire([&freed] { freed = true; });
+    EXPECT_FALSE(freed);
+    EXPECT_EQ(domain.pending(), 1);
+  }
+  EXPECT_EQ(domain.pending(), 0);
+  EXPECT_TRUE(freed);
+}
+
+TEST_F(EpochTest, ReaderPinnedAfterRetireDoesNotDelayFree) {
+  EpochDomain domain;
+  bool first = false;
+  std::atomic<bool> pinned = false;
+  std::atomic<bool> done = false;
+  std::thread reader([&] {
+    EpochDomain::Guard guard(domain);
+    pinned = true;
+    while (!done) {
+      std::this_thread::yield();
+    }
+  });
+  while (!pinned) {
+    std::this_thread::yield();
+  }
+  domain.retire([&first] { first = true; });
+  EXPECT_FALSE(first);
+  done = true;
+  reader.join();
+
+  EpochDomain::Guard late(domain);
+  bool second = false;
+  domain.retire([&second] { second = true; });
+  EXPECT_TRUE(first);
+  EXPECT_FALSE(second); // pinned by this thread before the retire
+}
+
+TEST_F(EpochTest, GuardsNest) {
+  EpochDomain domain;
+  bool freed = false;
+  {
+    EpochDomain::Guard outer(domain);
+    {
+      EpochDomain::Guard inner(domain);
+    }
+    domain.retire([&freed] { freed = true; });
+    EXPECT_FALSE(freed);
+  }
+  EXPECT_EQ(domain.pending(), 0);
+}
@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+
+#include "../lib/event_stream.h"
+#include "../lib/middleware.h"
+
+using namespace http;
+
+namespace {
+
+std::shared_ptr<const std::string> shared_segment(const net::Output &output, size_t index) {
+  return std::get<std::shared_ptr<const std::string>>(output.segments.at(index));
+}
+
+} // namespace
+
+class EventStreamTest : public ::testing::Test {};
+
+TEST_F(EventStreamTest, FormatsFieldsAndMultilineData) {
+  EXPECT_EQ(format_event({"hello"}), "data: hello\n\n");
+  EXPECT_EQ(format_event({.data = "a\nb", .event = "update", .id = "7"}), "id: 7\nevent: update\ndata: a\ndata: b\n\n");
+}
+
+TEST_F(EventStreamTest, PayloadsCannotInjectFields) {
+  // A bare CR ends a line for the client too
+  EXPECT_EQ(format_event({"a\rid: 9\r\nretry: 1\n"}), "data: a\ndata: id: 9\ndata: retry: 1\ndata: \n\n");
+  EXPECT_EQ(format_event({.data = "x", .event = "up\r\ndata: y", .id = "1\nretry: 0"}),
+            "id: 1retry: 0\nevent: updata: y\ndata: x\n\n");
+}
+
+TEST_F(EventStreamTest, BroadcastSharesOneBuffer) {
+  EventStream stream;
+  auto first = stream.subscribe();
+  auto second = stream.subscribe();
+  net::Output out_first, out_second;
+  first->on_open(out_first, {});
+  second->on_open(out_second, {});
+  EXPECT_EQ(stream.subscribers(), 2u);
+
+  stream.publish({"tick"});
+  EXPECT_FALSE(first->on_wake(out_first, false));
+  EXPECT_FALSE(second->on_wake(out_second, false));
+  ASSERT_EQ(out_first.segments.size(), 1u);
+  ASSERT_EQ(out_second.segments.size(), 1u);
+  EXPECT_EQ(shared_segment(out_first, 0), shared_segment(out_second, 0));
+  EXPECT_EQ(*shared_segment(out_first, 0), "data: tick\n\n");
+
+  second.reset();
+  EXPECT_EQ(stream.subscribers(), 1u);
+}
+
+TEST_F(EventStreamTest, BackloggedSubscriberWaitsForDrain) {
+  EventStream stream;
+  auto session = stream.subscribe();
+  net::Output output;
+  session->on_open(output, {});
+  stream.publish({"one"});
+  stream.publish({"two"});
+  EXPECT_FALSE(session->on_wake(output, true));
+  EXPECT_TRUE(output.empty());
+  EXPECT_FALSE(session->on_wake(output, false));
+  ASSERT_EQ(output.segments.size(), 2u);
+  EXPECT_EQ(*shared_segment(output, 1), "data: two\n\n");
+}
+
+TEST_F(EventStreamTest, CoalesceKeepsNewestEvents) {
+  EventStream stream({.max_queued = 2, .policy = SlowSubscriber::Coalesce});
+  auto session = stream.subscribe();
+  net::Output output;
+  session->on_open(output, {});
+  for (auto data : {"1", "2", "3", "4"}) {
+    stream.publish({data});
+  }
+  EXPECT_FALSE(session->on_wake(output, true));
+  EXPECT_FALSE(session->on_wake(output, false));
+  ASSERT_EQ(output.segments.size(), 2u);
+  EXPECT_EQ(*shared_segment(output, 0), "data: 3\n\n");
+  EXPECT_EQ(*shared_segment(output, 1), "data: 4\n\n");
+}
+
+TEST_F(EventStreamTest, DisconnectDropsSubscriberOverLimit) {
+  EventStream stream({.max_queued = 2, .policy = SlowSubscriber::Disconnect});
+  auto session = stream.subscribe();
+  net::Output output;
+  session->on_open(output, {});
+  stream.publish({"1"});
+  stream.publish({"2"});
+  EXPECT_FALSE(session->on_wake(output, true));
+  stream.publish({"3"});
+  EXPECT_TRUE(session->on_wake(output, true));
+}
+
+TEST_F(EventStreamTest, RouteStartsStreamWithoutContentLength) {
+  EventStream stream;
+  sse("/events/route-test", stream);
+  Request request{{Method::Get, "/events/route-test", "HTTP/1.1"}, {}, {}, {}};
+  Response response{};
+  Exchange exchange{request, response};
+  dispatch(exchange);
+  EXPECT_EQ(response.responseLine.status.code, status::OK.code);
+  ASSERT_TRUE(exchange.upgrade);
+  auto head = response.to_str();
+  EXPECT_NE(head.find("Content-Type: text/event-stream\r\n"), std::string::npos);
+  EXPECT_EQ(head.find("Content-Length"), std::string::npos);
+
+  Request head_request{{Method::Head, "/events/route-test", "HTTP/1.1"}, {}, {}, {}};
+  Response head_response{};
+  Exchange head_exchange{head_request, head_response};
+  dispatch(head_exchange);
+  EXPECT_FALSE(head_exchange.upgrade);
+}
@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+
+#include "../lib/hpack.h"
+
+using namespace http::hpack;
+using namespace std::string_literals;
+
+namespace {
+
+std::string from_hex(std::string_view hex) {
+  std::string bytes;
+  for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+    bytes += static_cast<char>(std::stoi(std::string(hex.substr(i, 2)), nullptr, 16));
+  }
+  return bytes;
+}
+
+} // namespace
+
+class HpackTest : public ::testing::Test {};
+
+TEST_F(HpackTest, HuffmanMatchesRfcExamples) {
+  for (auto [text, hex] : {std::pair{"www.example.com", "f1e3c2e5f23a6ba0ab90f4ff"}, {"no-cache", "a8eb10649cbf"},
+                           {"custom-key", "25a849e95ba97d7f"}, {"custom-value", "25a849e95bb8e8b4bf"}}) {
+    std::string encoded;
+    huffman_encode(text, encoded);
+    EXPECT_EQ(encoded, from_hex(hex)) << text;
+    EXPECT_EQ(huffman_encoded_size(text), encoded.size());
+    auto decoded = huffman_decode(encoded);
+    ASSERT_TRUE(decoded) << text;
+    EXPECT_EQ(*decoded, text);
+  }
+}
+
+TEST_F(HpackTest, HuffmanRoundTripsEveryByte) {
+  std::string all;
+  for (int c = 0; c < 256; ++c) {
+    all += static_cast<char>(c);
+  }
+  std::string encoded;
+  huffman_encode(all, encoded);
+  auto decoded = huffman_decode(encoded);
+  ASSERT_TRUE(decoded);
+  EXPECT_EQ(*decoded, all);
+}
+
+TEST_F(HpackTest, HuffmanRejectsInvalidPadding) {
+  // 'a' is 00011; the remaining bits must be a prefix of EOS (all ones)
+  EXPECT_EQ(huffman_decode("\x1f"s).value(), "a");
+  EXPECT_EQ(huffman_decode("\x18"s).error(), Error::InvalidHuffman);
+  // More than seven bits of padding
+  EXPECT_EQ(huffman_decode("\x1f\xff"s).error(), Error::InvalidHuffman);
+  // EOS itself must not appear
+  EXPECT_EQ(huffman_decode("\xff\xff\xff\xff"s).error(), Error::InvalidHuffman);
+}
+
+TEST_F(HpackTest, DecodesRequestSequenceWithDynamicTable) {
+  // RFC 7541 C.3: three requests on one connection, each referring to entries the previous added
+  Decoder decoder;
+  auto first = decoder.decode(from_hex("828684410f7777772e6578616d706c652e636f6d"));
+  ASSERT_TRUE(first);
+  ASSERT_EQ(first->size(), 4u);
+  EXPECT_EQ((*first)[0].name, ":method");
+  EXPECT_EQ((*first)[0].value, "GET");
+  EXPECT_EQ((*first)[2].value, "/");
+  EXPECT_EQ((*first)[3].name, ":authority");
+  EXPECT_EQ((*first)[3].value, "www.example.com");
+  EXPECT_EQ(decoder.table_size(), 57u);
+
+  auto second = decoder.decode(from_hex("828684be58086e6f2d6361636865"));
+  ASSERT_TRUE(second);
+  ASSERT_EQ(second->size(), 5u);
+  EXPECT_EQ((*second)[3].value, "www.example.com");
+  EXPECT_EQ((*second)[4].name, "cache-control");
+  EXPECT_EQ((*second)[4].value, "no-cache");
+  EXPECT_EQ(decoder.table_size(), 110u);
+
+  auto third = decoder.decode(
+      from_hex("828785bf400a637573746f6d2d6b65790c637573746f6d2d76616c7565"));
+  ASSERT_TRUE(third);
+  ASSERT_EQ(third->size(), 5u);
+  EXPECT_EQ((*third)[1].value, "https");
+  EXPECT_EQ((*third)[2].value, "/index.html");
+  EXPECT_EQ((*third)[3].value, "www.example.com");
+  EXPECT_EQ((*third)[4].name, "custom-key");
+  EXPECT_EQ((*third)[4].value, "custom-value");
+  EXPECT_EQ(decoder.table_size(), 164u);
+}
+
+TEST_F(HpackTest, DecodesHuffmanLiterals) {
+  // RFC 7541 C.4.1
+  Decoder decoder;
+  auto fields = decoder.decode(from_hex("828684418cf1e3c2e5f23a6ba0ab90f4ff"));
+  ASSERT_TRUE(fields);
+  ASSERT_EQ(fields->size(), 4u);
+  EXPECT_EQ((*fields)[3].value, "www.example.com");
+}
+
+TEST_F(HpackTest, EvictsOldestEntriesWhenTableShrinks) {
+  Decoder decoder(100);
+  ASSERT_TRUE(decoder.decode(from_hex("400a637573746f6d2d6b65790c637573746f6d2d76616c7565"))); // 54 bytes
+  ASSERT_TRUE(decoder.decode(from_hex("4003616263036465664003676869036a6b6c")));               // 38 each
+  EXPECT_EQ(decoder.table_size(), 76u);
+  // The newest entry is index 62, so the first has been evicted
+  auto newest = decoder.decode("\xbe"s);
+  ASSERT_TRUE(newest);
+  EXPECT_EQ((*newest)[0].name, "ghi");
+  EXPECT_EQ(decoder.decode("\xc0"s).error(), Error::InvalidIndex);
+
+  // A size update to zero empties the table; one above the advertised maximum is an error
+  ASSERT_TRUE(decoder.decode("\x20"s));
+  EXPECT_EQ(decoder.table_size(), 0u);
+  EXPECT_EQ(decoder.decode("\x3f\x62"s).error(), Error::TableSizeExceeded);
+}
+
+TEST_F(HpackTest, RejectsMalformedBlocks) {
+  Decoder decoder;
+  EXPECT_EQ(decoder.decode("\x80"s).error(), Error::InvalidIndex);
+  EXPECT_EQ(decoder.decode("\xbe"s).error(), Error::InvalidIndex);
+  EXPECT_EQ(decoder.decode("\x04\x05/ind"s).error(), Error::Truncated);
+  EXPECT_EQ(decoder.decode("\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01"s).error(), Error::IntegerOverflow);
+}
+
+TEST_F(HpackTest, EncodedFieldsDecodeWithoutTouchingTheTable) {
+  std::string block;
+  encode_field(block, ":status", "200");
+  encode_field(block, "content-type", "text/plain");
+  encode_field(block, "x-custom", "some value");
+  // ":status: 200" is a full static match, so it costs one byte
+  EXPECT_EQ(block[0], '\x88');
+
+  Decoder decoder;
+  auto fields = decoder.decode(block);
+  ASSERT_TRUE(fields);
+  ASSERT_EQ(fields->size(), 3u);
+  EXPECT_EQ((*fields)[0].value, "200");
+  EXPECT_EQ((*fields)[1].name, "content-type");
+  EXPECT_EQ((*fields)[1].value, "text/plain");
+  EXPECT_EQ((*fields)[2].name, "x-custom");
+  EXPECT_EQ((*fields)[2].value, "some value");
+  EXPECT_EQ(decoder.table_size(), 0u);
+}
+
+TEST_F(HpackTest, BoundsTheDecodedHeaderList) {
+  // One large table entry, then one-byte references to it: a small block that decodes to a huge list
+  std::string block = "\x40\x05x-big\x7f\xa1\x1e"s + std::string(4000, 'v');
+  block += std::string(1000, '\xbe');
+  Decoder decoder(4096, 16384);
+  EXPECT_EQ(decoder.decode(block).error(), Error::HeaderListTooLarge);
+  // The table was still updated, so the next block can refer to the entry
+  EXPECT_EQ(decoder.table_size(), 5u + 4000u + 32u);
+  auto next = decoder.decode("\xbe\xbe"s);
+  ASSERT_TRUE(next);
+  ASSERT_EQ(next->size(), 2u);
+  EXPECT_EQ((*next)[1].value.size(), 4000u);
+  // Bad references past the limit are still errors
+  EXPECT_EQ(decoder.decode(block + "\xff\x7f"s).error(), Error::InvalidIndex);
+}
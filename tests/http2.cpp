@@ -0,0 +1,616 @@
+#include <gtest/gtest.h>
+
+#include "../lib/event_stream.h"
+#include "../lib/http2.h"
+#include "../lib/server.h"
+
+using namespace http;
+using namespace http::h2;
+using namespace std::string_literals;
+
+namespace {
+
+struct Frame {
+  FrameType type;
+  uint8_t flags;
+  uint32_t stream_id;
+  std::string payload;
+};
+
+std::string u32(uint32_t value) {
+  return {static_cast<char>(value >> 24), static_cast<char>(value >> 16), static_cast<char>(value >> 8),
+          static_cast<char>(value)};
+}
+
+std::string frame(FrameType type, uint8_t flags, uint32_t stream_id, std::string_view payload = {}) {
+  std::string out;
+  write_frame_header(out, payload.size(), type, flags, stream_id);
+  out += payload;
+  return out;
+}
+
+std::string setting(uint16_t id, uint32_t value) {
+  return std::string{static_cast<char>(id >> 8), static_cast<char>(id)} + u32(value);
+}
+
+// A request header block: indexed :method GET / :scheme http, literal :path and :authority
+std::string request_block(std::string_view path, std::string_view method = "GET") {
+  std::string block;
+  hpack::encode_field(block, ":method", method);
+  hpack::encode_field(block, ":scheme", "http");
+  hpack::encode_field(block, ":path", path);
+  hpack::encode_field(block, ":authority", "localhost");
+  return block;
+}
+
+std::string output_bytes(const net::Output &output) {
+  std::string bytes;
+  for (const auto &segment : output.segments) {
+    if (auto *range = std::get_if<net::BufferSegment>(&segment)) {
+      bytes.append(output.buffer, range->offset, range->length);
+    } else if (auto *owned = std::get_if<std::string>(&segment)) {
+      bytes += *owned;
+    } else if (auto *shared = std::get_if<std::shared_ptr<const std::string>>(&segment)) {
+      bytes += **shared;
+    } else if (auto *fixed = std::get_if<net::StaticSegment>(&segment)) {
+      bytes += fixed->bytes;
+    } else if (auto *slice = std::get_if<net::SharedSlice>(&segment)) {
+      bytes.append(*slice->bytes, slice->offset, slice->length);
+    }
+  }
+  return bytes;
+}
+
+std::vector<Frame> parse_frames(std::string_view rest) {
+  std::vector<Frame> result;
+  while (auto header = parse_frame_header(rest)) {
+    result.push_back({header->type, header->flags, header->stream_id,
+                      std::string(rest.substr(FRAME_HEADER_SIZE, header->length))});
+    rest.remove_prefix(FRAME_HEADER_SIZE + header->length);
+  }
+  EXPECT_TRUE(rest.empty());
+  return result;
+}
+
+std::vector<Frame> frames(const net::Output &output) { return parse_frames(output_bytes(output)); }
+
+// Feeds `bytes` to the session the way the server does, returning the frames it queued in response
+std::vector<Frame> feed(net::Session &session, std::string &buffer, std::string_view bytes,
+                        net::HandlerResult *result = nullptr) {
+  net::Output output;
+  buffer += bytes;
+  auto handled = session.on_input(std::span<char>(buffer.data(), buffer.size()), output);
+  buffer.erase(0, handled.consumed);
+  if (result) {
+    *result = std::move(handled);
+  }
+  return frames(output);
+}
+
+std::string body_of(const std::vector<Frame> &sent, uint32_t stream_id) {
+  std::string body;
+  for (const auto &f : sent) {
+    if (f.type == FrameType::Data && f.stream_id == stream_id) {
+      body += f.payload;
+    }
+  }
+  return body;
+}
+
+// The receive credit the session granted `stream_id` (0 for the connection) in WINDOW_UPDATE frames
+uint32_t window_credit(const std::vector<Frame> &sent, uint32_t stream_id) {
+  uint32_t credit = 0;
+  for (const auto &f : sent) {
+    if (f.type == FrameType::WindowUpdate && f.stream_id == stream_id) {
+      const auto *p = reinterpret_cast<const uint8_t *>(f.payload.data());
+      credit += uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3];
+    }
+  }
+  return credit;
+}
+
+void serve_echo(Exchange &exchange) {
+  exchange.response.set_status(status::OK);
+  exchange.response.headers.set("Content-Type", "text/plain");
+  exchange.response.headers.set("Connection", "keep-alive");
+  exchange.response.body = exchange.request.requestLine.uri + ":" + exchange.request.body;
+}
+
+// A session past the preface and both SETTINGS exchanges
+std::unique_ptr<net::Session> open_session(std::string &buffer, Serve serve = serve_echo,
+                                           std::string settings = {}, StreamLog log = {}) {
+  auto session = http2_session(std::move(serve), std::move(log));
+  net::Output output;
+  session->on_open(output, {});
+  auto sent = frames(output);
+  EXPECT_EQ(sent.size(), 1u);
+  EXPECT_EQ(sent[0].type, FrameType::Settings);
+  auto ack = feed(*session, buffer, frame(FrameType::Settings, 0, 0, settings));
+  EXPECT_EQ(ack.size(), 1u);
+  EXPECT_EQ(ack[0].type, FrameType::Settings);
+  EXPECT_EQ(ack[0].flags, flag::ACK);
+  return session;
+}
+
+} // namespace
+
+class Http2Test : public ::testing::Test {};
+
+TEST_F(Http2Test, FrameHeadersRoundTrip) {
+  std::string out;
+  write_frame_header(out, 0x012345, FrameType::Headers, flag::END_HEADERS | flag::END_STREAM, 0x7fffffff);
+  ASSERT_EQ(out.size(), FRAME_HEADER_SIZE);
+  EXPECT_FALSE(parse_frame_header(std::string_view(out).substr(0, 8)));
+  auto header = parse_frame_header(out);
+  ASSERT_TRUE(header);
+  EXPECT_EQ(header->length, 0x012345u);
+  EXPECT_EQ(header->type, FrameType::Headers);
+  EXPECT_EQ(header->flags, flag::END_HEADERS | flag::END_STREAM);
+  EXPECT_EQ(header->stream_id, 0x7fffffffu);
+  // The reserved bit is ignored
+  out[5] = static_cast<char>(0xff);
+  EXPECT_EQ(parse_frame_header(out)->stream_id, 0x7fffffffu);
+}
+
+TEST_F(Http2Test, AnswersStreamsWithHeadersAndData) {
+  std::string buffer;
+  auto session = open_session(buffer);
+  auto sent = feed(*session, buffer, frame(FrameType::Headers, flag::END_HEADERS | flag::END_STREAM, 1,
+                                           request_block("/hello")));
+  ASSERT_EQ(sent.size(), 2u);
+  EXPECT_EQ(sent[0].type, FrameType::Headers);
+  EXPECT_EQ(sent[0].flags, flag::END_HEADERS);
+  hpack::Decoder decoder;
+  auto fields = decoder.decode(sent[0].payload);
+  ASSERT_TRUE(fields);
+  std::map<std::string, std::string> headers;
+  for (auto &[name, value] : *fields) {
+    headers[name] = value;
+  }
+  EXPECT_EQ(headers[":status"], "200");
+  EXPECT_EQ(headers["content-type"], "text/plain");
+  EXPECT_EQ(headers["content-length"], "7");
+  EXPECT_EQ(headers["server"], "http-server-cpp");
+  // Connection-specific headers have no meaning in HTTP/2
+  EXPECT_FALSE(headers.contains("connection"));
+
+  EXPECT_EQ(sent[1].type, FrameType::Data);
+  EXPECT_EQ(sent[1].flags, flag::END_STREAM);
+  EXPECT_EQ(sent[1].payload, "/hello:");
+}
+
+TEST_F(Http2Test, MapsPseudoHeadersToTheRequest) {
+  Request seen{};
+  std::string buffer;
+  auto session = open_session(buffer, [&seen](Exchange &exchange) {
+    seen = exchange.request;
+    exchange.response.set_status(status::CREATED);
+  });
+  std::string block = request_block("/submit?x=1", "POST");
+  hpack::encode_field(block, "user-agent", "test");
+  feed(*session, buffer, frame(FrameType::Headers, flag::END_HEADERS, 1, block));
+  auto sent = feed(*session, buffer, frame(FrameType::Data, flag::END_STREAM, 1, "payload"));
+  EXPECT_EQ(seen.requestLine.method, Method::Post);
+  EXPECT_EQ(seen.requestLine.uri, "/submit?x=1");
+  EXPECT_EQ(seen.headers.data["Host"], "localhost");
+  EXPECT_EQ(seen.headers.data["User-Agent"], "test");
+  EXPECT_EQ(seen.body, "payload");
+  // The bodiless response ends the stream; the connection window for the DATA is handed back
+  ASSERT_EQ(sent.size(), 2u);
+  EXPECT_EQ(sent[0].type, FrameType::Headers);
+  EXPECT_EQ(sent[0].flags & flag::END_STREAM, flag::END_STREAM);
+  EXPECT_EQ(sent[1].type, FrameType::WindowUpdate);
+  EXPECT_EQ(sent[1].payload, u32(7));
+}
+
+TEST_F(Http2Test, ReassemblesContinuationFrames) {
+  std::string buffer;
+  auto session = open_session(buffer);
+  std::string block = request_block("/split");
+  auto sent = feed(*session, buffer, frame(FrameType::Headers, flag::END_STREAM, 3, block.substr(0, 4)));
+  EXPECT_TRUE(sent.empty());
+  sent = feed(*session, buffer, frame(FrameType::Continuation, flag::END_HEADERS, 3, block.substr(4)));
+  EXPECT_EQ(body_of(sent, 3), "/split:");
+}
+
+TEST_F(Http2Test, RejectsFramesInsideAHeaderBlock) {
+  std::string buffer;
+  auto session = open_session(buffer);
+  feed(*session, buffer, frame(FrameType::Headers, flag::END_STREAM, 1, request_block("/")));
+  net::HandlerResult result{};
+  auto sent = feed(*session, buffer, frame(FrameType::Ping, 0, 0, "12345678"), &result);
+  ASSERT_EQ(sent.size(), 1u);
+  EXPECT_EQ(sent[0].type, FrameType::Goaway);
+  EXPECT_EQ(sent[0].payload.substr(4), u32(static_cast<uint32_t>(ErrorCode::ProtocolError)));
+  EXPECT_TRUE(result.close_connection);
+}
+
+TEST_F(Http2Test, AnswersPingsAndKeepsPartialFrames) {
+  std::string buffer;
+  auto session = open_session(buffer);
+  std::string ping = frame(FrameType::Ping, 0, 0, "abcdefgh");
+  net::HandlerResult result{};
+  EXPECT_TRUE(feed(*session, buffer, ping.substr(0, 10), &result).empty());
+  EXPECT_EQ(result.consumed, 0u);
+  auto sent = feed(*session, buffer, ping.substr(10), &result);
+  ASSERT_EQ(sent.size(), 1u);
+  EXPECT_EQ(sent[0].flags, flag::ACK);
+  EXPECT_EQ(sent[0].payload, "abcdefgh");
+  EXPECT_TRUE(buffer.empty());
+}
+
+TEST_F(Http2Test, DataWaitsForTheStreamWindow) {
+  std::string buffer;
+  auto session = open_session(
+      buffer,
+      [](Exchange &exchange) {
+        exchange.response.set_status(status::OK);
+        exchange.response.body = std::string(25, 'x');
+      },
+      setting(0x4, 10)); // SETTINGS_INITIAL_WINDOW_SIZE
+  auto sent = feed(*session, buffer, frame(FrameType::Headers, flag::END_HEADERS | flag::END_STREAM, 1,
+                                           request_block("/")));
+  EXPECT_EQ(body_of(sent, 1).size(), 10u);
+  EXPECT_EQ(sent.back().flags & flag::END_STREAM, 0);
+
+  sent = feed(*session, buffer, frame(FrameType::WindowUpdate, 0, 1, u32(5)));
+  EXPECT_EQ(body_of(sent, 1).size(), 5u);
+  sent = feed(*session, buffer, frame(FrameType::WindowUpdate, 0, 1, u32(100)));
+  ASSERT_EQ(sent.size(), 1u);
+  EXPECT_EQ(sent[0].payload.size(), 10u);
+  EXPECT_EQ(sent[0].flags, flag::END_STREAM);
+}
+
+TEST_F(Http2Test, InterleavesStreamsUnderTheConnectionWindow) {
+  std::string buffer;
+  auto session = open_session(buffer, [](Exchange &exchange) {
+    exchange.response.set_status(status::OK);
+    exchange.response.body = std::string(40000, exchange.request.requestLine.uri[1]);
+  });
+  // Both streams arrive together; 65535 bytes of connection window cover neither fully
+  auto sent = feed(*session, buffer,
+                   frame(FrameType::Headers, flag::END_HEADERS | flag::END_STREAM, 1, request_block("/a")) +
+                       frame(FrameType::Headers, flag::END_HEADERS | flag::END_STREAM, 3, request_block("/b")));
+  std::vector<uint32_t> order;
+  for (const auto &f : sent) {
+    if (f.type == FrameType::Data) {
+      order.push_back(f.stream_id);
+    }
+  }
+  ASSERT_GE(order.size(), 3u);
+  EXPECT_EQ(order[0], 1u);
+  EXPECT_EQ(order[1], 3u);
+  EXPECT_EQ(order[2], 1u);
+  EXPECT_EQ(body_of(sent, 1).size() + body_of(sent, 3).size(), DEFAULT_WINDOW);
+
+  sent = feed(*session, buffer,
+              frame(FrameType::WindowUpdate, 0, 0, u32(100000)) + frame(FrameType::WindowUpdate, 0, 1, u32(100000)) +
+                  frame(FrameType::WindowUpdate, 0, 3, u32(100000)));
+  EXPECT_EQ(body_of(sent, 1).size() + body_of(sent, 3).size(), 80000u - DEFAULT_WINDOW);
+  EXPECT_EQ(body_of(sent, 3).back(), 'b');
+}
+
+TEST_F(Http2Test, RefusesStreamsBeyondTheConcurrencyLimit) {
+  std::string buffer;
+  auto session = open_session(
+      buffer,
+      [](Exchange &exchange) {
+        exchange.response.set_status(status::OK);
+        exchange.response.body = "x";
+      },
+      setting(0x4, 0)); // no stream window, so answered streams stay open
+  std::string requests;
+  for (uint32_t id = 1; id <= 2 * MAX_CONCURRENT_STREAMS + 1; id += 2) {
+    requests += frame(FrameType::Headers, flag::END_HEADERS | flag::END_STREAM, id, request_block("/"));
+  }
+  auto sent = feed(*session, buffer, requests);
+  ASSERT_FALSE(sent.empty());
+  EXPECT_EQ(sent.back().type, FrameType::RstStream);
+  EXPECT_EQ(sent.back().stream_id, 2 * MAX_CONCURRENT_STREAMS + 1);
+  EXPECT_EQ(sent.back().payload, u32(static_cast<uint32_t>(ErrorCode::RefusedStream)));
+}
+
+TEST_F(Http2Test, AnswersOversizedHeaderListsWith431) {
+  std::string buffer;
+  auto session = open_session(buffer);
+  // One 4000-byte table entry referenced 60000 times: 64 KB on the wire, 240 MB decoded
+  std::string block = request_block("/") + "\x40\x05x-big\x7f\xa1\x1e"s + std::string(4000, 'v') +
+                      std::string(60000, '\xbe');
+  std::string frames_out;
+  for (size_t offset = 0; offset < block.size(); offset += DEFAULT_MAX_FRAME_SIZE) {
+    bool first = offset == 0;
+    bool last = offset + DEFAULT_MAX_FRAME_SIZE >= block.size();
+    frames_out += frame(first ? FrameType::Headers : FrameType::Continuation,
+                        (first ? flag::END_STREAM : 0) | (last ? flag::END_HEADERS : 0), 1,
+                        std::string_view(block).substr(offset, DEFAULT_MAX_FRAME_SIZE));
+  }
+  net::HandlerResult result{};
+  auto sent = feed(*session, buffer, frames_out, &result);
+  EXPECT_FALSE(result.close_connection);
+  ASSERT_EQ(sent.size(), 1u);
+  EXPECT_EQ(sent[0].type, FrameType::Headers);
+  EXPECT_EQ(sent[0].flags & flag::END_STREAM, flag::END_STREAM);
+  hpack::Decoder decoder;
+  EXPECT_EQ(decoder.decode(sent[0].payload)->front().value, "431");
+
+  // The connection's table is intact, so later streams still decode
+  sent = feed(*session, buffer, frame(FrameType::Headers, flag::END_HEADERS | flag::END_STREAM, 3,
+                                      request_block("/next") + "\xbe"s));
+  EXPECT_EQ(body_of(sent, 3), "/next:");
+}
+
+TEST_F(Http2Test, AppliesRouteLimitsBeforeBufferingTheBody) {
+  bool handled = false;
+  post("/h2/limited", [&handled](const Request &, Response &) { handled = true; }, {.max_body_size = 10});
+  post("/h2/guarded", [&handled](const Request &, Response &) { handled = true; },
+       {.precondition = [](const Request &) -> std::optional<Status> { return status::BAD_REQUEST; }});
+  std::string buffer;
+  auto session = open_session(buffer, dispatch);
+  hpack::Decoder decoder;
+
+  // A declared length over the route's limit is answered from the head, and the client told to stop
+  std::string block = request_block("/h2/limited", "POST");
+  hpack::encode_field(block, "content-length", "100");
+  auto sent = feed(*session, buffer, frame(FrameType::Headers, flag::END_HEADERS, 1, block));
+  ASSERT_EQ(sent.size(), 2u);
+  EXPECT_EQ(sent[0].flags & flag::END_STREAM, flag::END_STREAM);
+  EXPECT_EQ(decoder.decode(sent[0].payload)->front().value, "413");
+  EXPECT_EQ(sent[1].type, FrameType::RstStream);
+  EXPECT_EQ(sent[1].payload, u32(static_cast<uint32_t>(ErrorCode::NoError)));
+
+  // Without one, the route's limit still bounds the DATA
+  feed(*session, buffer, frame(FrameType::Headers, flag::END_HEADERS, 3, request_block("/h2/limited", "POST")));
+  sent = feed(*session, buffer, frame(FrameType::Data, flag::END_STREAM, 3, "eleven byte"));
+  ASSERT_FALSE(sent.empty());
+  EXPECT_EQ(sent[0].stream_id, 3u);
+  EXPECT_EQ(decoder.decode(sent[0].payload)->front().value, "413");
+
+  // Preconditions run on the head too
+  sent = feed(*session, buffer, frame(FrameType::Headers, flag::END_HEADERS | flag::END_STREAM, 5,
+                                      request_block("/h2/guarded", "POST")));
+  ASSERT_EQ(sent.size(), 1u);
+  EXPECT_EQ(decoder.decode(sent[0].payload)->front().value, "400");
+  EXPECT_FALSE(handled);
+
+  feed(*session, buffer, frame(FrameType::Headers, flag::END_HEADERS, 7, request_block("/h2/limited", "POST")));
+  sent = feed(*session, buffer, frame(FrameType::Data, flag::END_STREAM, 7, "small"));
+  EXPECT_TRUE(handled);
+  ASSERT_FALSE(sent.empty());
+  EXPECT_EQ(decoder.decode(sent[0].payload)->front().value, "201");
+}
+
+TEST_F(Http2Test, EnforcesTheConnectionReceiveWindow) {
+  std::string buffer;
+  auto session = open_session(buffer);
+  std::string chunk(DEFAULT_MAX_FRAME_SIZE, 'x');
+  feed(*session, buffer,
+       frame(FrameType::Headers, flag::END_HEADERS, 1, request_block("/a", "POST")) +
+           frame(FrameType::Headers, flag::END_HEADERS, 3, request_block("/b", "POST")));
+
+  // Within one read, four full frames are one byte more than the connection window
+  net::HandlerResult result{};
+  auto sent = feed(*session, buffer,
+                   frame(FrameType::Data, 0, 1, chunk) + frame(FrameType::Data, 0, 3, chunk) +
+                       frame(FrameType::Data, 0, 1, chunk) + frame(FrameType::Data, 0, 3, chunk),
+                   &result);
+  EXPECT_TRUE(result.close_connection);
+  ASSERT_FALSE(sent.empty());
+  EXPECT_EQ(sent.back().type, FrameType::Goaway);
+  EXPECT_EQ(sent.back().payload.substr(4), u32(static_cast<uint32_t>(ErrorCode::FlowControlError)));
+}
+
+TEST_F(Http2Test, BoundsStreamCreditByRouteAndBufferedBodies) {
+  post("/h2/small", [](const Request &, Response &res) { res.set_status(status::OK); }, {.max_body_size = 10});
+  post(
+      "/h2/upload",
+      [](const Request &req, Response &res) {
+        res.set_status(status::OK);
+        res.body = std::to_string(req.body.size());
+      },
+      {.max_body_size = 4 * 1024 * 1024});
+  std::string buffer;
+  auto session = open_session(buffer, dispatch);
+  std::string chunk(DEFAULT_MAX_FRAME_SIZE, 'x');
+
+  // A route that takes ten bytes is never offered more than its initial window
+  feed(*session, buffer, frame(FrameType::Headers, flag::END_HEADERS, 1, request_block("/h2/small", "POST")));
+  auto sent = feed(*session, buffer, frame(FrameType::Data, 0, 1, "four"));
+  EXPECT_EQ(window_credit(sent, 1), 0u);
+  EXPECT_EQ(window_credit(sent, 0), 4u);
+  feed(*session, buffer, frame(FrameType::Data, flag::END_STREAM, 1, ""));
+
+  // The oldest upload is topped up as it arrives, even past the connection's buffering limit
+  feed(*session, buffer,
+       frame(FrameType::Headers, flag::END_HEADERS, 3, request_block("/h2/upload", "POST")) +
+           frame(FrameType::Headers, flag::END_HEADERS, 5, request_block("/h2/upload", "POST")) +
+           frame(FrameType::Headers, flag::END_HEADERS, 7, request_block("/h2/upload", "POST")));
+  for (int i = 0; i < 64; ++i) {
+    sent = feed(*session, buffer, frame(FrameType::Data, 0, 3, chunk));
+    ASSERT_EQ(window_credit(sent, 3), chunk.size());
+  }
+
+  // Later ones get no more credit until it is served
+  sent = feed(*session, buffer, frame(FrameType::Data, 0, 5, chunk));
+  EXPECT_EQ(window_credit(sent, 0), chunk.size());
+  EXPECT_EQ(window_credit(sent, 5), 0u);
+  sent = feed(*session, buffer, frame(FrameType::Data, 0, 7, chunk));
+  EXPECT_EQ(window_credit(sent, 7), 0u);
+
+  // A peer that sends past the window it was given loses the stream
+  feed(*session, buffer, frame(FrameType::Data, 0, 7, chunk) + frame(FrameType::Data, 0, 7, chunk));
+  sent = feed(*session, buffer, frame(FrameType::Data, 0, 7, chunk));
+  ASSERT_FALSE(sent.empty());
+  EXPECT_EQ(sent[0].type, FrameType::RstStream);
+  EXPECT_EQ(sent[0].stream_id, 7u);
+  EXPECT_EQ(sent[0].payload, u32(static_cast<uint32_t>(ErrorCode::FlowControlError)));
+
+  // Serving the oldest releases its body and the next upload resumes
+  sent = feed(*session, buffer, frame(FrameType::Data, flag::END_STREAM, 3, ""));
+  EXPECT_EQ(body_of(sent, 3), std::to_string(64 * chunk.size()));
+  EXPECT_EQ(window_credit(sent, 5), chunk.size());
+}
+
+TEST_F(Http2Test, RefusesEventStreamsWithHttp11Required) {
+  EventStream events;
+  sse("/h2/events", events);
+  std::string buffer;
+  auto session = open_session(buffer, dispatch);
+
+  auto sent = feed(*session, buffer,
+                   frame(FrameType::Headers, flag::END_HEADERS | flag::END_STREAM, 1, request_block("/h2/events")));
+  ASSERT_EQ(sent.size(), 1u);
+  EXPECT_EQ(sent[0].type, FrameType::RstStream);
+  EXPECT_EQ(sent[0].stream_id, 1u);
+  EXPECT_EQ(sent[0].payload, u32(static_cast<uint32_t>(ErrorCode::Http11Required)));
+}
+
+TEST_F(Http2Test, RefusesProtocolSwitchesWithHttp11Required) {
+  bool opened = false;
+  get(
+      "/h2/switch",
+      [](const Request &, Response &res) {
+        res.set_status(status::SWITCHING_PROTOCOLS);
+        res.headers.set("Upgrade", "example");
+      },
+      {.upgrade = [&opened](const Request &) {
+        opened = true;
+        return std::unique_ptr<net::Session>{};
+      }});
+  std::string buffer;
+  auto session = open_session(buffer, dispatch);
+
+  auto sent = feed(*session, buffer,
+                   frame(FrameType::Headers, flag::END_HEADERS | flag::END_STREAM, 1, request_block("/h2/switch")));
+  ASSERT_EQ(sent.size(), 1u);
+  EXPECT_EQ(sent[0].type, FrameType::RstStream);
+  EXPECT_EQ(sent[0].payload, u32(static_cast<uint32_t>(ErrorCode::Http11Required)));
+  EXPECT_TRUE(opened);
+
+  // The connection carries on with other streams
+  sent = feed(*session, buffer,
+              frame(FrameType::Headers, flag::END_HEADERS | flag::END_STREAM, 3, request_block("/h2/none")));
+  ASSERT_FALSE(sent.empty());
+  EXPECT_EQ(sent[0].type, FrameType::Headers);
+  EXPECT_EQ(sent[0].stream_id, 3u);
+}
+
+TEST_F(Http2Test, ReportsAnsweredStreamsToTheLog) {
+  post("/h2/logged", [](const Request &, Response &res) { res.send("done"); }, {.max_body_size = 4});
+  struct Entry {
+    std::string path;
+    uint16_t status;
+    size_t bytes;
+    bool operator==(const Entry &) const = default;
+  };
+  std::vector<Entry> entries;
+  std::string buffer;
+  auto session = open_session(buffer, dispatch, {},
+                              [&entries](const net::RequestContext &, const Request *request, uint16_t status,
+                                         size_t bytes) { entries.push_back({std::string(request->path()), status, bytes}); });
+
+  feed(*session, buffer,
+       frame(FrameType::Headers, flag::END_HEADERS, 1, request_block("/h2/logged", "POST")) +
+           frame(FrameType::Data, flag::END_STREAM, 1, "ok"));
+  feed(*session, buffer,
+       frame(FrameType::Headers, flag::END_HEADERS, 3, request_block("/h2/logged", "POST")) +
+           frame(FrameType::Data, 0, 3, "too long"));
+  // Reset without a status: nothing to log
+  feed(*session, buffer,
+       frame(FrameType::Headers, flag::END_HEADERS | flag::END_STREAM, 5, request_block("/h2/logged", "PATCH")));
+  EXPECT_EQ(entries, (std::vector<Entry>{{"/h2/logged", 201, 4}, {"/h2/logged", 413, 0}}));
+}
+
+TEST_F(Http2Test, ShedsStreamsRefusedByAdmissionControl) {
+  std::vector<uint16_t> rejected;
+  net::Options options;
+  // The preface is the connection's first request and takes one token, stream 1 the other
+  options.admission = {.rate = 1, .burst = 2};
+  options.on_reject = [&rejected](const net::RequestContext &, uint16_t status, size_t) { rejected.push_back(status); };
+  net::Loopback loopback(options);
+  net::LoopbackScript script{{std::string(HTTP2_PREFACE) + frame(FrameType::Settings, 0, 0) +
+                              frame(FrameType::Headers, flag::END_HEADERS | flag::END_STREAM, 1, request_block("/a")) +
+                              frame(FrameType::Headers, flag::END_HEADERS | flag::END_STREAM, 3, request_block("/b"))}};
+  auto received = loopback.run(script, [](std::string_view input, net::Output &, const net::RequestContext &) {
+    if (input.size() < HTTP2_PREFACE.size()) {
+      return net::HandlerResult{0, false};
+    }
+    return net::HandlerResult{HTTP2_PREFACE.size(), false, http2_session(serve_echo)};
+  });
+
+  std::map<uint32_t, std::map<std::string, std::string>> responses;
+  hpack::Decoder decoder;
+  for (const auto &f : parse_frames(received)) {
+    if (f.type != FrameType::Headers) {
+      continue;
+    }
+    auto fields = decoder.decode(f.payload);
+    ASSERT_TRUE(fields);
+    for (auto &[name, value] : *fields) {
+      responses[f.stream_id][name] = value;
+    }
+  }
+  EXPECT_EQ(responses[1][":status"], "200");
+  EXPECT_EQ(responses[3][":status"], "503");
+  EXPECT_EQ(responses[3]["retry-after"], "1");
+  EXPECT_EQ(rejected, std::vector<uint16_t>{503});
+}
+
+TEST_F(Http2Test, UpgradesH2cRequestsToStreamOne) {
+  Headers headers;
+  // Both lists are matched as case-insensitive tokens
+  headers.set("Upgrade", "websocket, H2C");
+  headers.set("Connection", "upgrade, http2-settings");
+  headers.set("HTTP2-Settings", "AAMAAABkAAQAoAAAAAIAAAAA");
+  Request request{{Method::Get, "/upgraded", "HTTP/1.1"}, std::move(headers), {}, {}};
+  Response response{};
+  Exchange exchange{request, response};
+  bool continued = false;
+  H2cUpgrade{serve_echo}(exchange, [&continued](Exchange &) { continued = true; });
+  EXPECT_FALSE(continued);
+  EXPECT_EQ(response.responseLine.status.code, status::SWITCHING_PROTOCOLS.code);
+  EXPECT_EQ(response.headers.data["Upgrade"], "h2c");
+  ASSERT_TRUE(exchange.upgrade);
+
+  net::Output output;
+  exchange.upgrade->on_open(output, {});
+  auto sent = frames(output);
+  ASSERT_FALSE(sent.empty());
+  EXPECT_EQ(sent[0].type, FrameType::Settings);
+  EXPECT_EQ(body_of(sent, 1), "/upgraded:");
+
+  // The client still sends the preface, possibly in pieces
+  std::string buffer;
+  net::HandlerResult result{};
+  feed(*exchange.upgrade, buffer, HTTP2_PREFACE.substr(0, 5), &result);
+  EXPECT_EQ(result.consumed, 0u);
+  sent = feed(*exchange.upgrade, buffer, std::string(HTTP2_PREFACE.substr(5)) + frame(FrameType::Settings, 0, 0),
+              &result);
+  EXPECT_FALSE(result.close_connection);
+  EXPECT_TRUE(buffer.empty());
+  ASSERT_EQ(sent.size(), 1u);
+  EXPECT_EQ(sent[0].flags, flag::ACK);
+}
+
+TEST_F(Http2Test, LeavesOtherUpgradesToHttp1) {
+  auto upgrades = [](std::string connection, bool with_settings) {
+    Headers headers;
+    headers.set("Upgrade", "h2c");
+    headers.set("Connection", connection);
+    if (with_settings) {
+      headers.set("HTTP2-Settings", "");
+    }
+    Request request{{Method::Get, "/", "HTTP/1.1"}, std::move(headers), {}, {}};
+    Response response{};
+    Exchange exchange{request, response};
+    bool continued = false;
+    H2cUpgrade{serve_echo}(exchange, [&continued](Exchange &) { continued = true; });
+    EXPECT_EQ(continued, !exchange.upgrade);
+    return bool(exchange.upgrade);
+  };
+  EXPECT_TRUE(upgrades("Upgrade, HTTP2-Settings", true));
+  EXPECT_FALSE(upgrades("Upgrade, HTTP2-Settings", false));
+  // RFC 7540 3.2: the settings must be marked hop-by-hop, and the upgrade requested
+  EXPECT_FALSE(upgrades("Upgrade", true));
+  EXPECT_FALSE(upgrades("HTTP2-Settings", true));
+  EXPECT_FALSE(upgrades("keep-alive", true));
+}
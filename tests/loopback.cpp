@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+
+#include "../lib/middleware.h"
+#include "../lib/parse.h"
+#include "../lib/server.h"
+
+using namespace http;
+
+namespace {
+
+net::HandlerResult serve(std::string_view input, net::Output &out, const net::RequestContext &) {
+  auto length = message_length(input);
+  if (!length) {
+    return {0, false};
+  }
+  auto request = parse_request(input.substr(0, *length));
+  Response response{};
+  if (!request) {
+    response.set_status(status::BAD_REQUEST);
+    response.write_to(out);
+    return {input.size(), true};
+  }
+  Exchange exchange{*request, response};
+  Pipeline pipeline(KeepAlive{}, HeadMethod{});
+  pipeline(exchange, dispatch);
+  response.write_to(out);
+  return {*length, exchange.close_connection};
+}
+
+std::string echo_request(const std::string &text, bool close = false) {
+  return "GET /loopback/" + text + " HTTP/1.1\r\nHost: localhost\r\n" + (close ? "Connection: close\r\n" : "") + "\r\n";
+}
+
+size_t count(const std::string &haystack, std::string_view needle) {
+  size_t n = 0;
+  for (size_t pos = haystack.find(needle); pos != std::string::npos; pos = haystack.find(needle, pos + 1)) {
+    n++;
+  }
+  return n;
+}
+
+} // namespace
+
+class LoopbackTest : public ::testing::Test {
+protected:
+  static void SetUpTestSuite() {
+    get("/loopback/:text", [](const Request &req, Response &res) { res.send(req.params.at("text")); });
+  }
+};
+
+TEST_F(LoopbackTest, ServesRequestSplitAcrossReads) {
+  net::Loopback loopback;
+  auto request = echo_request("split");
+  net::LoopbackScript script{{request.substr(0, 5), request.substr(5, 20), request.substr(25)}};
+  auto received = loopback.run(script, serve);
+  EXPECT_EQ(count(received, "HTTP/1.1 200 OK\r\n"), 1u);
+  EXPECT_TRUE(received.ends_with("\r\n\r\nsplit"));
+}
+
+TEST_F(LoopbackTest, AnswersPipelinedRequestsInOrder) {
+  net::Loopback loopback;
+  net::LoopbackScript script{{echo_request("one") + echo_request("two") + echo_request("three")}};
+  auto received = loopback.run(script, serve);
+  EXPECT_EQ(count(received, "HTTP/1.1 200 OK\r\n"), 3u);
+  auto one = received.find("\r\n\r\none");
+  auto two = received.find("\r\n\r\ntwo");
+  auto three = received.find("\r\n\r\nthree");
+  ASSERT_NE(three, std::string::npos);
+  EXPECT_LT(one, two);
+  EXPECT_LT(two, three);
+}
+
+TEST_F(LoopbackTest, SlowReaderReceivesEverything) {
+  net::Loopback loopback;
+  net::LoopbackScript script{{echo_request("a") + echo_request("b"), echo_request("c")}, 7};
+  auto received = loopback.run(script, serve);
+  EXPECT_EQ(count(received, "HTTP/1.1 200 OK\r\n"), 3u);
+  EXPECT_TRUE(received.ends_with("\r\n\r\nc"));
+}
+
+TEST_F(LoopbackTest, ConnectionCloseStopsReading) {
+  net::Loopback loopback;
+  net::LoopbackScript script{{echo_request("first", true) + echo_request("ignored")}};
+  auto received = loopback.run(script, serve);
+  EXPECT_EQ(count(received, "HTTP/1.1 200 OK\r\n"), 1u);
+  EXPECT_EQ(received.find("ignored"), std::string::npos);
+}
+
+TEST_F(LoopbackTest, EdgeTriggeredMatchesLevelTriggered) {
+  std::string pipelined;
+  for (int i = 0; i < 50; i++) {
+    pipelined += echo_request("req" + std::to_string(i));
+  }
+  net::LoopbackScript script{{pipelined.substr(0, 1000), pipelined.substr(1000)}, 512};
+  auto level = net::Loopback().run(script, serve);
+  auto edge = net::Loopback({.edge_triggered = true, .read_budget = 256}).run(script, serve);
+  EXPECT_EQ(count(level, "HTTP/1.1 200 OK\r\n"), 50u);
+  EXPECT_EQ(count(edge, "HTTP/1.1 200 OK\r\n"), 50u);
+  // Date headers may differ between the runs, but the bodies arrive in the same order
+  EXPECT_EQ(level.size(), edge.size());
+}
+
+TEST_F(LoopbackTest, AnswersRequestsBeyondTheLargestBufferWith413) {
+  std::vector<uint16_t> rejected;
+  net::Loopback loopback({.on_reject = [&rejected](const net::RequestContext &, uint16_t status, size_t) {
+    rejected.push_back(status);
+  }});
+  // A handler that never sees a complete message, as for a route allowing bodies above 1 MiB
+  auto endless = [](std::string_view, net::Output &, const net::RequestContext &) -> net::HandlerResult {
+    return {0, false};
+  };
+  std::string chunk(256 << 10, 'x');
+  net::LoopbackScript script{{chunk, chunk, chunk, chunk, chunk}};
+  auto received = loopback.run(script, endless);
+  EXPECT_TRUE(received.starts_with("HTTP/1.1 413 Content Too Large\r\n"));
+  EXPECT_EQ(count(received, "HTTP/1.1"), 1u);
+  EXPECT_EQ(rejected, std::vector<uint16_t>{413});
+}
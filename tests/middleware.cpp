@@ -0,0 +1,189 @@
+#include <gtest/gtest.h>
+
+#include "../lib/middleware.h"
+
+#include <fstream>
+
+using namespace http;
+
+namespace {
+
+struct Trace {
+  std::string &log;
+  char name;
+
+  template <typename Next> void operator()(Exchange &exchange, Next &&next) const {
+    log += name;
+    next(exchange);
+    log += static_cast<char>(std::toupper(name));
+  }
+};
+
+struct ShortCircuit {
+  template <typename Next> void operator()(Exchange &exchange, Next &&next) const {
+    exchange.response.set_status(status::BAD_REQUEST);
+  }
+};
+
+Request make_request(const std::string &uri, Headers headers = {}) {
+  return Request{{Method::Get, uri, "HTTP/1.1"}, std::move(headers), {}, {}};
+}
+
+} // namespace
+
+class MiddlewareTest : public ::testing::Test {};
+
+TEST_F(MiddlewareTest, StagesWrapHandlerInOrder) {
+  std::string log;
+  Pipeline pipeline(Trace{log, 'a'}, Trace{log, 'b'});
+  auto request = make_request("/");
+  Response response{};
+  Exchange exchange{request, response};
+  pipeline(exchange, [&log](Exchange &) { log += '*'; });
+  EXPECT_EQ(log, "ab*BA");
+}
+
+TEST_F(MiddlewareTest, StageCanAnswerWithoutNext) {
+  std::string log;
+  Pipeline pipeline(Trace{log, 'a'}, ShortCircuit{}, Trace{log, 'b'});
+  auto request = make_request("/");
+  Response response{};
+  Exchange exchange{request, response};
+  pipeline(exchange, [&log](Exchange &) { log += '*'; });
+  EXPECT_EQ(log, "aA");
+  EXPECT_EQ(response.responseLine.status.code, status::BAD_REQUEST.code);
+}
+
+TEST_F(MiddlewareTest, DynamicPipelineNestsInStaticOne) {
+  std::string log;
+  DynamicPipeline dynamic;
+  dynamic.use(Trace{log, 'b'}).use([&log](Exchange &exchange, const DynamicPipeline::Next &next) {
+    log += 'c';
+    next(exchange);
+  });
+  Pipeline pipeline(Trace{log, 'a'}, std::ref(dynamic));
+  auto request = make_request("/");
+  Response response{};
+  Exchange exchange{request, response};
+  pipeline(exchange, [&log](Exchange &) { log += '*'; });
+  EXPECT_EQ(log, "abc*BA");
+}
+
+TEST_F(MiddlewareTest, KeepAliveEchoesConnectionClose) {
+  Headers headers;
+  headers.set("Connection", "close");
+  auto request = make_request("/", headers);
+  Response response{};
+  Exchange exchange{request, response};
+  Pipeline(KeepAlive{})(exchange, [](Exchange &) {});
+  EXPECT_TRUE(exchange.close_connection);
+  EXPECT_EQ(response.headers.data.at("Connection"), "close");
+}
+
+TEST_F(MiddlewareTest, GzipSkipsNotModified) {
+  Headers headers;
+  headers.set("Accept-Encoding", "gzip");
+  auto request = make_request("/", headers);
+  Response response{};
+  Exchange exchange{request, response};
+  Pipeline(Gzip{})(exchange, [](Exchange &e) { e.response.send("hello"); });
+  EXPECT_EQ(response.headers.data.at("Content-Encoding"), "gzip");
+
+  Response not_modified{};
+  Exchange second{request, not_modified};
+  Pipeline(Gzip{})(second, [](Exchange &e) { e.response.set_status(status::NOT_MODIFIED); });
+  EXPECT_FALSE(not_modified.headers.data.contains("Content-Encoding"));
+}
+
+TEST_F(MiddlewareTest, NotModifiedCarriesTheEncodedValidator) {
+  std::string path = testing::TempDir() + "middleware_gzip_etag.txt";
+  std::ofstream(path) << "compressible compressible compressible";
+  auto serve = [&path](Exchange &e) { e.response.send_file(path, e.request); };
+  Headers headers;
+  headers.set("Accept-Encoding", "gzip");
+  auto request = make_request("/", headers);
+  Response full{};
+  Exchange exchange{request, full};
+  Pipeline(Gzip{})(exchange, serve);
+  ASSERT_EQ(full.headers.data.at("Content-Encoding"), "gzip");
+  const auto &etag = full.headers.data.at("ETag");
+  EXPECT_TRUE(etag.ends_with("-gzip\""));
+  EXPECT_EQ(full.headers.data.at("Vary"), "Accept-Encoding");
+
+  request.headers.set("If-None-Match", etag);
+  Response not_modified{};
+  Exchange revalidate{request, not_modified};
+  Pipeline(Gzip{})(revalidate, serve);
+  EXPECT_EQ(not_modified.responseLine.status.code, status::NOT_MODIFIED.code);
+  EXPECT_EQ(not_modified.headers.data.at("ETag"), etag);
+  EXPECT_EQ(not_modified.headers.data.at("Vary"), "Accept-Encoding");
+
+  // The identity representation is a different one
+  Request identity = make_request("/");
+  identity.headers.set("If-None-Match", etag);
+  Response plain{};
+  Exchange other{identity, plain};
+  Pipeline(Gzip{})(other, serve);
+  EXPECT_EQ(plain.responseLine.status.code, status::OK.code);
+  EXPECT_FALSE(plain.headers.data.at("ETag").ends_with("-gzip\""));
+  EXPECT_EQ(plain.headers.data.at("Vary"), "Accept-Encoding");
+  std::remove(path.c_str());
+}
+
+TEST_F(MiddlewareTest, HeadDropsBodyButKeepsLength) {
+  auto request = make_request("/");
+  request.requestLine.method = Method::Head;
+  Response response{};
+  Exchange exchange{request, response};
+  Pipeline(HeadMethod{})(exchange, [](Exchange &e) { e.response.send("hello"); });
+  EXPECT_TRUE(response.body.empty());
+  EXPECT_EQ(response.headers.data.at("Content-Length"), "5");
+}
+
+TEST_F(MiddlewareTest, CacheServesSecondRequest) {
+  get("/middleware/cached", [](const Request &, Response &res) { res.send("fresh"); },
+      {.cache = CachePolicy{std::chrono::seconds(60), {}}});
+  ResponseCache cache(16);
+  Pipeline pipeline(KeepAlive{}, Cache{cache});
+
+  auto request = make_request("/middleware/cached");
+  Response first{};
+  Exchange miss{request, first};
+  pipeline(miss, dispatch);
+  ASSERT_TRUE(miss.serialized);
+
+  Response second{};
+  Exchange hit{request, second};
+  bool dispatched = false;
+  pipeline(hit, [&dispatched](Exchange &) { dispatched = true; });
+  EXPECT_FALSE(dispatched);
+  EXPECT_EQ(hit.serialized, miss.serialized);
+}
+
+TEST_F(MiddlewareTest, DispatchAppliesRouteLimitsToCompleteMessages) {
+  bool handled = false;
+  post("/middleware/limited", [&handled](const Request &, Response &res) { handled = true; },
+       {.max_body_size = 10, .precondition = [](const Request &req) -> std::optional<Status> {
+          return req.headers.data.contains("X-Deny") ? std::optional(status::NOT_FOUND) : std::nullopt;
+        }});
+  // Head and body arrived in one read, so nothing checked them while the body was awaited
+  auto send = [](Headers headers, std::string body, bool head_checked = false) {
+    headers.set("Content-Length", std::to_string(body.size()));
+    Request request{{Method::Post, "/middleware/limited", "HTTP/1.1"}, std::move(headers), {}, std::move(body)};
+    Response response{};
+    Exchange exchange{request, response};
+    exchange.head_checked = head_checked;
+    dispatch(exchange);
+    return response.responseLine.status.code;
+  };
+
+  EXPECT_EQ(send({}, std::string(20, 'x')), status::CONTENT_TOO_LARGE.code);
+  Headers deny;
+  deny.set("X-Deny", "1");
+  EXPECT_EQ(send(deny, "small"), status::NOT_FOUND.code);
+  EXPECT_FALSE(handled);
+
+  // A head checked while its body was read is not checked again
+  send(deny, "small", true);
+  EXPECT_TRUE(handled);
+}
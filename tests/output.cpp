@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+
+#include "../lib/config.h"
+#include "../lib/output.h"
+
+using namespace net;
+
+class OutputTest : public ::testing::Test {};
+
+TEST_F(OutputTest, AdjacentBufferWritesShareOneSegment) {
+  Output out;
+  out.append(std::string_view("HTTP/1.1 200 OK\r\n\r\n"));
+  out.append(std::string("small body"));
+
+  ASSERT_EQ(out.segments.size(), 1);
+  EXPECT_EQ(out.buffer, "HTTP/1.1 200 OK\r\n\r\nsmall body");
+  EXPECT_EQ(out.size(), out.buffer.size());
+}
+
+TEST_F(OutputTest, LargeBodyIsMovedNotCopied) {
+  Output out;
+  std::string body(config::INLINE_BODY_SIZE + 1, 'x');
+  const char *data = body.data();
+  out.append(std::string_view("head"));
+  out.append(std::move(body));
+
+  ASSERT_EQ(out.segments.size(), 2);
+  EXPECT_EQ(std::get<std::string>(out.segments[1]).data(), data);
+  EXPECT_EQ(out.buffer, "head");
+}
+
+TEST_F(OutputTest, SharedBytesAndFilesKeepOrder) {
+  Output out;
+  out.append(std::make_shared<const std::string>("cached"));
+  out.append(FileSegment{std::make_shared<const File>(-1), 10, 20});
+  out.append(std::string_view("tail"));
+
+  ASSERT_EQ(out.segments.size(), 3);
+  EXPECT_TRUE(std::holds_alternative<std::shared_ptr<const std::string>>(out.segments[0]));
+  EXPECT_TRUE(std::holds_alternative<FileSegment>(out.segments[1]));
+  EXPECT_TRUE(std::holds_alternative<BufferSegment>(out.segments[2]));
+  EXPECT_EQ(out.size(), 6 + 20 + 4);
+
+  out.clear();
+  EXPECT_TRUE(out.empty());
+  EXPECT_TRUE(out.buffer.empty());
+}
+
+TEST_F(OutputTest, LargeStaticBytesAreReferenced) {
+  static const std::string embedded(config::INLINE_BODY_SIZE + 1, 'x');
+  Output out;
+  out.append(StaticSegment{embedded});
+  out.append(StaticSegment{"tiny"});
+
+  ASSERT_EQ(out.segments.size(), 2);
+  EXPECT_EQ(std::get<StaticSegment>(out.segments[0]).bytes.data(), embedded.data());
+  EXPECT_EQ(out.buffer, "tiny");
+  EXPECT_EQ(out.size(), embedded.size() + 4);
+}
+
+TEST_F(OutputTest, SharedSlicesReferenceOneBuffer) {
+  auto body = std::make_shared<const std::string>(2 * config::INLINE_BODY_SIZE + 10, 'x');
+  Output out;
+  out.append(SharedSlice{body, 0, config::INLINE_BODY_SIZE + 1});
+  out.append(SharedSlice{body, config::INLINE_BODY_SIZE + 1, 9});
+
+  ASSERT_EQ(out.segments.size(), 2);
+  EXPECT_EQ(std::get<SharedSlice>(out.segments[0]).bytes, body);
+  EXPECT_EQ(out.buffer, std::string(9, 'x'));
+  EXPECT_EQ(out.size(), config::INLINE_BODY_SIZE + 1 + 9);
+}
@@ -84,3 +84,124 @@ TEST_F(ParseConnectionTest, FullRequestWithoutConnectionHeader) {
   ASSERT_TRUE(result.has_value());
   EXPECT_EQ(result->headers.data.find("Connection"), result->headers.data.end());
 }
+
+class ParseRequestLineTest : public ::testing::Test {};
+
+TEST_F(ParseRequestLineTest, HeadMethod) {
+  auto result = parse_request_line("HEAD /files/a HTTP/1.1");
+  ASSERT_TRUE(result.has_value());
+  EXPECT_EQ(result->method, Method::Head);
+}
+
+class ParseRangeTest : public ::testing::Test {};
+
+TEST_F(ParseRangeTest, SingleRange) {
+  auto result = parse_range("bytes=0-99", 1000);
+  ASSERT_TRUE(result.has_value());
+  ASSERT_EQ(result->size(), 1);
+  EXPECT_EQ((*result)[0].first, 0);
+  EXPECT_EQ((*result)[0].last, 99);
+}
+
+TEST_F(ParseRangeTest, OpenEndedAndSuffixRanges) {
+  auto result = parse_range("bytes=900-, -50", 1000);
+  ASSERT_TRUE(result.has_value());
+  ASSERT_EQ(result->size(), 2);
+  EXPECT_EQ((*result)[0].first, 900);
+  EXPECT_EQ((*result)[0].last, 999);
+  EXPECT_EQ((*result)[1].first, 950);
+  EXPECT_EQ((*result)[1].last, 999);
+}
+
+TEST_F(ParseRangeTest, LastPositionClampedToSize) {
+  auto result = parse_range("bytes=10-5000", 100);
+  ASSERT_TRUE(result.has_value());
+  EXPECT_EQ((*result)[0].last, 99);
+}
+
+TEST_F(ParseRangeTest, UnsatisfiableRange) {
+  auto result = parse_range("bytes=100-200", 100);
+  ASSERT_FALSE(result.has_value());
+  EXPECT_EQ(result.error(), ParseError::UnsatisfiableRange);
+}
+
+TEST_F(ParseRangeTest, MalformedRange) {
+  EXPECT_EQ(parse_range("items=0-1", 100).error(), ParseError::MalformedRange);
+  EXPECT_EQ(parse_range("bytes=5-1", 100).error(), ParseError::MalformedRange);
+  EXPECT_EQ(parse_range("bytes=a-b", 100).error(), ParseError::MalformedRange);
+}
+
+class MessageLengthTest : public ::testing::Test {};
+
+TEST_F(MessageLengthTest, IncompleteHead) {
+  EXPECT_FALSE(message_length("GET / HTTP/1.1\r\nHost: x\r\n").has_value());
+}
+
+TEST_F(MessageLengthTest, HeadWithoutBody) {
+  std::string_view req = "GET / HTTP/1.1\r\nHost: x\r\n\r\nGET /next HTTP/1.1\r\n";
+  EXPECT_EQ(message_length(req), req.find("GET /next"));
+}
+
+TEST_F(MessageLengthTest, BodyCountsTowardsLength) {
+  std::string_view req = "POST /f HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello";
+  EXPECT_EQ(message_length(req), req.size());
+  EXPECT_FALSE(message_length(req.substr(0, req.size() - 1)).has_value());
+}
+
+class PercentDecodeTest : public ::testing::Test {};
+
+TEST_F(PercentDecodeTest, DecodesInPlace) {
+  std::string s = "a%20b%2Fc";
+  s.resize(percent_decode(s.data(), s.size()));
+  EXPECT_EQ(s, "a b/c");
+}
+
+TEST_F(PercentDecodeTest, KeepsMalformedEscapes) {
+  std::string s = "100%zz%4";
+  s.resize(percent_decode(s.data(), s.size()));
+  EXPECT_EQ(s, "100%zz%4");
+}
+
+TEST_F(PercentDecodeTest, PlusAsSpaceOnlyWhenAsked) {
+  std::string s = "a+b";
+  EXPECT_EQ(percent_decode(s.data(), s.size()), 3);
+  EXPECT_EQ(s, "a+b");
+  percent_decode(s.data(), s.size(), true);
+  EXPECT_EQ(s, "a b");
+}
+
+class QueryTest : public ::testing::Test {};
+
+TEST_F(QueryTest, PathStopsAtQuery) {
+  auto request = parse_request("GET /echo/abc?x=1 HTTP/1.1\r\n\r\n");
+  ASSERT_TRUE(request.has_value());
+  EXPECT_EQ(request->path(), "/echo/abc");
+  EXPECT_EQ(request->requestLine.uri, "/echo/abc?x=1");
+}
+
+TEST_F(QueryTest, ParsedOnlyOnFirstAccess) {
+  auto request = parse_request("GET /search?q=hello+world&lang=c%2B%2B&flag&empty= HTTP/1.1\r\n\r\n");
+  ASSERT_TRUE(request.has_value());
+  EXPECT_FALSE(request->query_string.parsed);
+  EXPECT_EQ(request->query("q"), "hello world");
+  EXPECT_TRUE(request->query_string.parsed);
+  EXPECT_EQ(request->query("lang"), "c++");
+  EXPECT_EQ(request->query("flag"), "");
+  EXPECT_EQ(request->query("empty"), "");
+  EXPECT_FALSE(request->query("missing").has_value());
+}
+
+TEST_F(QueryTest, ValuesPointIntoRequest) {
+  auto request = parse_request("GET /p?a=1 HTTP/1.1\r\n\r\n");
+  auto value = request->query("a");
+  ASSERT_TRUE(value.has_value());
+  EXPECT_GE(value->data(), request->query_string.buffer.data());
+  EXPECT_LT(value->data(), request->query_string.buffer.data() + request->query_string.buffer.size());
+}
+
+TEST_F(QueryTest, CopiesStayValid) {
+  auto request = parse_request("GET /p?key=a-value-longer-than-small-string-storage HTTP/1.1\r\n\r\n");
+  request->query("key");
+  Request copy = *request;
+  EXPECT_EQ(copy.query("key"), "a-value-longer-than-small-string-storage");
+}
@@ -72,3 +72,69 @@ TEST_F(ResponseEncodingTest, InvalidCompressionMethodNoEncoding) {
   EXPECT_EQ(res.headers.data.at("Content-Length"), "11");
   EXPECT_EQ(res.headers.data.count("Content-Encoding"), 0);
 }
+
+TEST_F(ResponseEncodingTest, WriteHeadRendersStatusLineAndHeaders) {
+  Response res{};
+  res.set_status(status::CREATED);
+  res.send("abc");
+
+  std::string head;
+  res.write_head(head);
+  EXPECT_TRUE(head.starts_with("HTTP/1.1 201 Created\r\n"));
+  EXPECT_NE(head.find("Content-Length: 3\r\n"), std::string::npos);
+  EXPECT_NE(head.find("Date: "), std::string::npos);
+  EXPECT_NE(head.find("Server: "), std::string::npos);
+  EXPECT_TRUE(head.ends_with("\r\n\r\n"));
+  EXPECT_EQ(head.find("abc"), std::string::npos);
+}
+
+TEST_F(ResponseEncodingTest, CachedBytesGetTheCurrentDateOnReplay) {
+  Response res{};
+  res.set_status(status::OK);
+  res.send("abc");
+
+  auto cached = std::make_shared<const std::string>(res.to_cached());
+  EXPECT_EQ(cached->find("HTTP/1.1"), std::string::npos);
+  EXPECT_EQ(cached->find("Date: "), std::string::npos);
+  EXPECT_TRUE(cached->ends_with("\r\n\r\nabc"));
+
+  net::Output out;
+  write_cached(out, cached);
+  EXPECT_TRUE(out.buffer.starts_with("HTTP/1.1 200 OK\r\nDate: "));
+  EXPECT_EQ(out.size(), out.buffer.size() + cached->size());
+}
+
+TEST_F(ResponseEncodingTest, WriteHeadAppendsToReusedBuffer) {
+  Response res{};
+  res.set_status(status::OK);
+
+  std::string head = "previous";
+  head.clear();
+  res.write_head(head);
+  EXPECT_TRUE(head.starts_with("HTTP/1.1 200 OK\r\n"));
+  EXPECT_EQ(head.find("previous"), std::string::npos);
+}
+
+TEST_F(ResponseEncodingTest, WriteHeadRendersUnknownStatus) {
+  Response res{};
+  res.set_status({418, "I'm a teapot"});
+
+  std::string head;
+  res.write_head(head);
+  EXPECT_TRUE(head.starts_with("HTTP/1.1 418 I'm a teapot\r\n"));
+}
+
+TEST_F(ResponseEncodingTest, WriteHeadAddsMissingContentLength) {
+  Response res{};
+  res.set_status(status::CREATED);
+
+  std::string head;
+  res.write_head(head);
+  EXPECT_NE(head.find("Content-Length: 0\r\n"), std::string::npos);
+
+  Response not_modified{};
+  not_modified.set_status(status::NOT_MODIFIED);
+  std::string bodiless;
+  not_modified.write_head(bodiless);
+  EXPECT_EQ(bodiless.find("Content-Length"), std::string::npos);
+}
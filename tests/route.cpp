@@ -1,6 +1,8 @@
 #include <gtest/gtest.h>
 
+#include <atomic>
 #include <fstream>
+#include <thread>
 
 #include "../lib/config.h"
 #include "../lib/route.h"
@@ -160,6 +162,36 @@ TEST_F(RoutePublicAPITest, ParameterizedRouteMultipleParams) {
   EXPECT_EQ(captured_post, "99");
 }
 
+TEST_F(RoutePublicAPITest, QueryStringIsNotPartOfRoute) {
+  std::string captured;
+  get("/query/:content", [&captured](const Request &req, Response &res) {
+    captured = req.params.at("content") + "|" + std::string(req.query("x").value_or("-"));
+  });
+
+  Request req = make_request(Method::Get, "/query/abc?x=1");
+  Response res{};
+  dispatch(req, res);
+  EXPECT_EQ(res.responseLine.status.code, 200);
+  EXPECT_EQ(captured, "abc|1");
+}
+
+TEST_F(RoutePublicAPITest, ParamSegmentsArePercentDecoded) {
+  std::string captured;
+  get("/decoded/:name", [&captured](const Request &req, Response &res) { captured = req.params.at("name"); });
+
+  Request req = make_request(Method::Get, "/decoded/hello%20world");
+  Response res{};
+  dispatch(req, res);
+  EXPECT_EQ(captured, "hello world");
+}
+
+TEST_F(RoutePublicAPITest, EncodedSlashDoesNotMatchParam) {
+  get("/decoded-slash/:name", [](const Request &req, Response &res) {});
+
+  Request req = make_request(Method::Get, "/decoded-slash/..%2Fsecret");
+  EXPECT_FALSE(match_route(req));
+}
+
 TEST_F(RoutePublicAPITest, ExactRoutePreferredOverParam) {
   std::string matched;
   get("/users/me",
@@ -301,3 +333,250 @@ TEST_F(RoutePublicAPITest, PostFileGetMethodReturns404) {
   dispatch(req, res);
   EXPECT_EQ(res.responseLine.status.code, 404);
 }
+
+TEST_F(RoutePublicAPITest, HeadFallsBackToGetHandler) {
+  bool called = false;
+  get("/api/head-test",
+      [&called](const Request &req, Response &res) { called = true; });
+
+  Request req = make_request(Method::Head, "/api/head-test");
+  Response res{};
+  dispatch(req, res);
+  EXPECT_TRUE(called);
+  EXPECT_EQ(res.responseLine.status.code, 200);
+}
+
+TEST_F(RoutePublicAPITest, SendFileSetsValidators) {
+  std::string tmp_dir = testing::TempDir();
+  std::string path = tmp_dir + "test_validators.txt";
+  std::ofstream(path) << "validated";
+
+  Response res{};
+  res.send_file(path, make_request(Method::Get, "/"));
+  EXPECT_EQ(res.responseLine.status.code, 200);
+  EXPECT_TRUE(res.headers.data.contains("ETag"));
+  EXPECT_TRUE(res.headers.data.contains("Last-Modified"));
+
+  std::remove(path.c_str());
+}
+
+TEST_F(RoutePublicAPITest, SendFileIfNoneMatchReturns304) {
+  std::string tmp_dir = testing::TempDir();
+  std::string path = tmp_dir + "test_if_none_match.txt";
+  std::ofstream(path) << "unchanged";
+
+  Response first{};
+  first.send_file(path);
+  Request req = make_request(Method::Get, "/");
+  req.headers.set("If-None-Match", "\"other\", " + first.headers.data.at("ETag"));
+
+  Response res{};
+  res.send_file(path, req);
+  EXPECT_EQ(res.responseLine.status.code, 304);
+  EXPECT_TRUE(res.body.empty());
+  EXPECT_EQ(res.headers.data.at("ETag"), first.headers.data.at("ETag"));
+
+  req.headers.set("If-None-Match", "\"other\"");
+  Response changed{};
+  changed.send_file(path, req);
+  EXPECT_EQ(changed.responseLine.status.code, 200);
+  EXPECT_EQ(changed.body, "unchanged");
+
+  std::remove(path.c_str());
+}
+
+TEST_F(RoutePublicAPITest, SendFileIfModifiedSinceReturns304) {
+  std::string tmp_dir = testing::TempDir();
+  std::string path = tmp_dir + "test_if_modified_since.txt";
+  std::ofstream(path) << "unchanged";
+
+  Request req = make_request(Method::Get, "/");
+  req.headers.set("If-Modified-Since", format_http_date(std::time(nullptr) + 60));
+  Response res{};
+  res.send_file(path, req);
+  EXPECT_EQ(res.responseLine.status.code, 304);
+
+  req.headers.set("If-Modified-Since", "Thu, 01 Jan 1970 00:00:00 GMT");
+  Response modified{};
+  modified.send_file(path, req);
+  EXPECT_EQ(modified.responseLine.status.code, 200);
+
+  std::remove(path.c_str());
+}
+
+TEST_F(RoutePublicAPITest, SendFileSingleRangeReturns206) {
+  std::string path = testing::TempDir() + "test_range.txt";
+  std::ofstream(path) << "0123456789";
+
+  Request req = make_request(Method::Get, "/");
+  req.headers.set("Range", "bytes=2-5");
+  Response res{};
+  res.send_file(path, req);
+  EXPECT_EQ(res.responseLine.status.code, 206);
+  EXPECT_EQ(res.body, "2345");
+  EXPECT_EQ(res.headers.data.at("Content-Range"), "bytes 2-5/10");
+  EXPECT_EQ(res.headers.data.at("Content-Length"), "4");
+
+  std::remove(path.c_str());
+}
+
+TEST_F(RoutePublicAPITest, SendFileMultiRangeReturnsMultipart) {
+  std::string path = testing::TempDir() + "test_multi_range.txt";
+  std::ofstream(path) << "0123456789";
+
+  Request req = make_request(Method::Get, "/");
+  req.headers.set("Range", "bytes=0-1,-2");
+  Response res{};
+  res.send_file(path, req);
+  EXPECT_EQ(res.responseLine.status.code, 206);
+  EXPECT_TRUE(res.headers.data.at("Content-Type").starts_with("multipart/byteranges; boundary="));
+  EXPECT_NE(res.body.find("Content-Range: bytes 0-1/10\r\n\r\n01\r\n"), std::string::npos);
+  EXPECT_NE(res.body.find("Content-Range: bytes 8-9/10\r\n\r\n89\r\n"), std::string::npos);
+
+  std::remove(path.c_str());
+}
+
+TEST_F(RoutePublicAPITest, SendFileUnsatisfiableRangeReturns416) {
+  std::string path = testing::TempDir() + "test_bad_range.txt";
+  std::ofstream(path) << "0123456789";
+
+  Request req = make_request(Method::Get, "/");
+  req.headers.set("Range", "bytes=50-60");
+  Response res{};
+  res.send_file(path, req);
+  EXPECT_EQ(res.responseLine.status.code, 416);
+  EXPECT_EQ(res.headers.data.at("Content-Range"), "bytes */10");
+
+  std::remove(path.c_str());
+}
+
+TEST_F(RoutePublicAPITest, SendFileStaleIfRangeReturnsFullFile) {
+  std::string path = testing::TempDir() + "test_if_range.txt";
+  std::ofstream(path) << "0123456789";
+
+  Request req = make_request(Method::Get, "/");
+  req.headers.set("Range", "bytes=2-5");
+  req.headers.set("If-Range", "\"stale\"");
+  Response res{};
+  res.send_file(path, req);
+  EXPECT_EQ(res.responseLine.status.code, 200);
+  EXPECT_EQ(res.body, "0123456789");
+
+  std::remove(path.c_str());
+}
+
+TEST_F(RoutePublicAPITest, SendFileLargeFileUsesFileSegment) {
+  std::string path = testing::TempDir() + "test_large_file.bin";
+  std::string content(2 * config::SENDFILE_THRESHOLD, 'z');
+  std::ofstream(path, std::ios::binary) << content;
+
+  Response res{};
+  res.send_file(path, make_request(Method::Get, "/"));
+  EXPECT_EQ(res.responseLine.status.code, 200);
+  EXPECT_TRUE(res.body.empty());
+  ASSERT_TRUE(res.file.has_value());
+  EXPECT_EQ(res.file->offset, 0);
+  EXPECT_EQ(res.file->length, content.size());
+  EXPECT_EQ(res.headers.data.at("Content-Length"), std::to_string(content.size()));
+
+  Request ranged = make_request(Method::Get, "/");
+  ranged.headers.set("Range", "bytes=100-");
+  Response partial{};
+  partial.send_file(path, ranged);
+  EXPECT_EQ(partial.responseLine.status.code, 206);
+  ASSERT_TRUE(partial.file.has_value());
+  EXPECT_EQ(partial.file->offset, 100);
+  EXPECT_EQ(partial.file->length, content.size() - 100);
+
+  std::remove(path.c_str());
+}
+
+TEST_F(RoutePublicAPITest, CheckRequestHeadUnknownRouteIs404) {
+  Request req = make_request(Method::Post, "/no-such-upload/a");
+  auto status = check_request_head(req);
+  ASSERT_TRUE(status.has_value());
+  EXPECT_EQ(status->code, 404);
+}
+
+TEST_F(RoutePublicAPITest, CheckRequestHeadEnforcesBodyLimit) {
+  post("/limited/:name", [](const Request &req, Response &res) {}, {.max_body_size = 10});
+
+  Request small = make_request(Method::Post, "/limited/a");
+  small.headers.set("Content-Length", "10");
+  EXPECT_FALSE(check_request_head(small).has_value());
+
+  Request large = make_request(Method::Post, "/limited/a");
+  large.headers.set("Content-Length", "11");
+  auto status = check_request_head(large);
+  ASSERT_TRUE(status.has_value());
+  EXPECT_EQ(status->code, 413);
+}
+
+TEST_F(RoutePublicAPITest, CheckRequestHeadRejectsUnknownExpectation) {
+  post("/expect/:name", [](const Request &req, Response &res) {});
+
+  Request req = make_request(Method::Post, "/expect/a");
+  req.headers.set("Expect", "100-continue");
+  EXPECT_FALSE(check_request_head(req).has_value());
+  // Expectation values are case-insensitive
+  req.headers.set("Expect", "100-Continue");
+  EXPECT_FALSE(check_request_head(req).has_value());
+
+  req.headers.set("Expect", "something-else");
+  auto status = check_request_head(req);
+  ASSERT_TRUE(status.has_value());
+  EXPECT_EQ(status->code, 417);
+}
+
+TEST_F(RoutePublicAPITest, CheckRequestHeadRunsPrecondition) {
+  post(
+      "/guarded/:name", [](const Request &req, Response &res) {},
+      {.precondition = [](const Request &req) -> std::optional<Status> {
+        if (req.params.at("name") == "forbidden") {
+          return status::NOT_FOUND;
+        }
+        return std::nullopt;
+      }});
+
+  Request allowed = make_request(Method::Post, "/guarded/ok");
+  EXPECT_FALSE(check_request_head(allowed).has_value());
+  Request rejected = make_request(Method::Post, "/guarded/forbidden");
+  EXPECT_EQ(check_request_head(rejected)->code, 404);
+}
+
+TEST_F(RoutePublicAPITest, MatchingWhileRoutesAreAdded) {
+  get("/concurrent/stable", [](const Request &req, Response &res) {});
+  std::atomic<bool> done = false;
+  std::atomic<int> misses = 0;
+  std::thread reader([&] {
+    while (!done) {
+      Request req = make_request(Method::Get, "/concurrent/stable");
+      if (!match_route(req)) {
+        misses++;
+      }
+    }
+  });
+  for (int i = 0; i < 200; ++i) {
+    get("/concurrent/added/" + std::to_string(i), [](const Request &req, Response &res) {});
+  }
+  done = true;
+  reader.join();
+  EXPECT_EQ(misses, 0);
+
+  Request added = make_request(Method::Get, "/concurrent/added/199");
+  EXPECT_TRUE(match_route(added));
+}
+
+TEST_F(RoutePublicAPITest, ReloadReplacesAllRoutes) {
+  get("/reload/old", [](const Request &req, Response &res) {});
+  reload_routes([] {
+    get("/reload/new/:id", [](const Request &req, Response &res) { res.send(req.params.at("id")); });
+  });
+
+  Request old_req = make_request(Method::Get, "/reload/old");
+  EXPECT_FALSE(match_route(old_req));
+  Request new_req = make_request(Method::Get, "/reload/new/7");
+  Response res{};
+  dispatch(new_req, res);
+  EXPECT_EQ(res.body, "7");
+}
@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../lib/socket.h"
+
+using namespace net;
+
+class ParseAddressTest : public ::testing::Test {};
+
+TEST_F(ParseAddressTest, EmptyListensOnAllIPv4Interfaces) {
+  auto address = parse_address("", 4221);
+  ASSERT_TRUE(address.has_value());
+  EXPECT_EQ(address->family(), AF_INET);
+  EXPECT_EQ(address_host(*address), "0.0.0.0");
+  EXPECT_EQ(ntohs(reinterpret_cast<const sockaddr_in *>(&address->storage)->sin_port), 4221);
+}
+
+TEST_F(ParseAddressTest, IPv4WithPort) {
+  auto address = parse_address("127.0.0.1:8080", 4221);
+  ASSERT_TRUE(address.has_value());
+  EXPECT_EQ(address_host(*address), "127.0.0.1");
+  EXPECT_EQ(ntohs(reinterpret_cast<const sockaddr_in *>(&address->storage)->sin_port), 8080);
+}
+
+TEST_F(ParseAddressTest, PortOnly) {
+  auto address = parse_address(":9000", 4221);
+  ASSERT_TRUE(address.has_value());
+  EXPECT_EQ(address->family(), AF_INET);
+  EXPECT_EQ(ntohs(reinterpret_cast<const sockaddr_in *>(&address->storage)->sin_port), 9000);
+}
+
+TEST_F(ParseAddressTest, BracketedIPv6) {
+  auto address = parse_address("[::1]:8443", 4221);
+  ASSERT_TRUE(address.has_value());
+  EXPECT_EQ(address->family(), AF_INET6);
+  EXPECT_EQ(address_host(*address), "::1");
+  EXPECT_EQ(ntohs(reinterpret_cast<const sockaddr_in6 *>(&address->storage)->sin6_port), 8443);
+}
+
+TEST_F(ParseAddressTest, BareIPv6UsesDefaultPort) {
+  auto address = parse_address("::", 4221);
+  ASSERT_TRUE(address.has_value());
+  EXPECT_EQ(address->family(), AF_INET6);
+  EXPECT_EQ(ntohs(reinterpret_cast<const sockaddr_in6 *>(&address->storage)->sin6_port), 4221);
+}
+
+TEST_F(ParseAddressTest, UnixSocket) {
+  auto address = parse_address("unix:/tmp/http.sock", 4221);
+  ASSERT_TRUE(address.has_value());
+  EXPECT_EQ(address->family(), AF_UNIX);
+  EXPECT_STREQ(reinterpret_cast<const sockaddr_un *>(&address->storage)->sun_path, "/tmp/http.sock");
+  EXPECT_EQ(address_host(*address), "");
+}
+
+TEST_F(ParseAddressTest, RejectsInvalidAddresses) {
+  EXPECT_FALSE(parse_address("localhost:80", 4221).has_value());
+  EXPECT_FALSE(parse_address("127.0.0.1:99999", 4221).has_value());
+  EXPECT_FALSE(parse_address("[::1", 4221).has_value());
+  EXPECT_FALSE(parse_address("unix:", 4221).has_value());
+}
+
+class BindListenerTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    path = "/tmp/http-server-test-" + std::to_string(getpid()) + ".sock";
+    unlink(path.c_str());
+  }
+  void TearDown() override { unlink(path.c_str()); }
+
+  Address address() const { return *parse_address("unix:" + path, 0); }
+
+  std::string path;
+};
+
+TEST_F(BindListenerTest, ReplacesStaleSocketFile) {
+  int first = bind_listener(address(), {});
+  ASSERT_GE(first, 0);
+  close(first); // bound but never listening, like a socket left by a crashed run
+  int second = bind_listener(address(), {});
+  EXPECT_GE(second, 0);
+  close(second);
+}
+
+TEST_F(BindListenerTest, KeepsFilesThatAreNotSockets) {
+  std::ofstream(path) << "data";
+  EXPECT_EQ(bind_listener(address(), {}), -1);
+  struct stat st;
+  ASSERT_EQ(lstat(path.c_str(), &st), 0);
+  EXPECT_TRUE(S_ISREG(st.st_mode));
+}
+
+TEST_F(BindListenerTest, RefusesPathOfLiveListener) {
+  int live = bind_listener(address(), {});
+  ASSERT_GE(live, 0);
+  ASSERT_EQ(listen(live, 1), 0);
+  EXPECT_EQ(bind_listener(address(), {}), -1);
+  close(live);
+}
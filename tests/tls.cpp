@@ -0,0 +1,193 @@
+#include <gtest/gtest.h>
+
+#ifdef HTTP_SERVER_TLS
+
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../lib/tls.h"
+
+using namespace net;
+
+namespace {
+
+// Writes a self-signed P-256 certificate for `localhost` and its key as PEM files
+void write_self_signed(const std::string &cert_path, const std::string &key_path) {
+  EVP_PKEY *key = EVP_EC_gen("P-256");
+  X509 *cert = X509_new();
+  ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+  X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+  X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+  X509_set_pubkey(cert, key);
+  X509_NAME *name = X509_get_subject_name(cert);
+  X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char *>("localhost"), -1, -1,
+                             0);
+  X509_set_issuer_name(cert, name);
+  X509_sign(cert, key, EVP_sha256());
+
+  FILE *f = fopen(cert_path.c_str(), "w");
+  PEM_write_X509(f, cert);
+  fclose(f);
+  f = fopen(key_path.c_str(), "w");
+  PEM_write_PrivateKey(f, key, nullptr, nullptr, 0, nullptr, nullptr);
+  fclose(f);
+  X509_free(cert);
+  EVP_PKEY_free(key);
+}
+
+class Loopback {
+public:
+  Loopback(const TlsContext &context, SSL_CTX *client_ctx, SSL_SESSION *session = nullptr) {
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    server = std::make_unique<TlsStream>(context, fds[0]);
+    client = SSL_new(client_ctx);
+    SSL_set_fd(client, fds[1]);
+    if (session) {
+      SSL_set_session(client, session);
+    }
+  }
+
+  ~Loopback() {
+    SSL_shutdown(client);
+    SSL_free(client);
+    server.reset();
+    close(fds[0]);
+    close(fds[1]);
+  }
+
+  // Both sides run on this thread, so each takes a step until neither is waiting on the other
+  bool handshake() {
+    bool server_done = false;
+    bool client_done = false;
+    for (int i = 0; i < 100 && !(server_done && client_done); ++i) {
+      if (!client_done) {
+        client_done = SSL_connect(client) == 1;
+      }
+      if (!server_done) {
+        server_done = server->handshake() == 1;
+        if (!server_done && errno != EAGAIN) {
+          return false;
+        }
+      }
+    }
+    return server_done && client_done;
+  }
+
+  // Reads whatever the server sent; the client's reads also process session tickets
+  std::string client_read(size_t expected) {
+    std::string out;
+    char buf[4096];
+    for (int i = 0; i < 1000 && out.size() < expected; ++i) {
+      size_t n = 0;
+      if (SSL_read_ex(client, buf, sizeof(buf), &n) == 1) {
+        out.append(buf, n);
+      }
+    }
+    return out;
+  }
+
+  int fds[2];
+  std::unique_ptr<TlsStream> server;
+  SSL *client;
+};
+
+} // namespace
+
+class TlsTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    auto dir = std::filesystem::temp_directory_path();
+    cert = (dir / "tls_test_cert.pem").string();
+    key = (dir / "tls_test_key.pem").string();
+    write_self_signed(cert, key);
+    client_ctx = SSL_CTX_new(TLS_client_method());
+  }
+
+  void TearDown() override {
+    SSL_CTX_free(client_ctx);
+    std::filesystem::remove(cert);
+    std::filesystem::remove(key);
+  }
+
+  std::string cert;
+  std::string key;
+  SSL_CTX *client_ctx;
+};
+
+TEST_F(TlsTest, RejectsMissingCertificate) {
+  TlsContext context(TlsOptions{"/nonexistent/cert.pem", "/nonexistent/key.pem"});
+  EXPECT_FALSE(context.valid());
+}
+
+TEST_F(TlsTest, RequestAndResponseOverLoopback) {
+  TlsContext context(TlsOptions{cert, key});
+  ASSERT_TRUE(context.valid());
+  Loopback loop(context, client_ctx);
+  ASSERT_TRUE(loop.handshake());
+
+  std::string request = "GET / HTTP/1.1\r\n\r\n";
+  ASSERT_EQ(SSL_write(loop.client, request.data(), request.size()), static_cast<int>(request.size()));
+  char buf[256];
+  ssize_t n = loop.server->read(buf, sizeof(buf));
+  ASSERT_EQ(std::string(buf, n), request);
+
+  std::string head = "HTTP/1.1 200 OK\r\n";
+  std::string body = "\r\nhello";
+  struct iovec iov[2] = {{head.data(), head.size()}, {body.data(), body.size()}};
+  EXPECT_EQ(loop.server->writev(iov, 2), static_cast<ssize_t>(head.size() + body.size()));
+  EXPECT_EQ(loop.client_read(head.size() + body.size()), head + body);
+}
+
+TEST_F(TlsTest, SendfileWithoutKtlsFallsBackToUserSpace) {
+  TlsContext context(TlsOptions{cert, key});
+  Loopback loop(context, client_ctx);
+  ASSERT_TRUE(loop.handshake());
+  EXPECT_FALSE(loop.server->ktls_send()); // no kTLS on Unix domain sockets
+
+  auto path = std::filesystem::temp_directory_path() / "tls_test_file.bin";
+  std::string content(40000, 'x');
+  std::ofstream(path, std::ios::binary) << content;
+  int fd = open(path.c_str(), O_RDONLY);
+  std::string received;
+  off_t offset = 100;
+  while (offset < static_cast<off_t>(content.size())) {
+    ssize_t n = loop.server->sendfile(fd, offset, content.size() - offset);
+    if (n > 0) {
+      offset += n;
+    }
+    received += loop.client_read(1);
+  }
+  received += loop.client_read(content.size() - 100 - received.size());
+  close(fd);
+  std::filesystem::remove(path);
+  EXPECT_EQ(received, content.substr(100));
+}
+
+TEST_F(TlsTest, SessionsAreResumed) {
+  TlsContext context(TlsOptions{cert, key});
+  SSL_SESSION *session = nullptr;
+  {
+    Loopback first(context, client_ctx);
+    ASSERT_TRUE(first.handshake());
+    EXPECT_FALSE(first.server->resumed());
+    std::string ping = "ping";
+    struct iovec iov = {ping.data(), ping.size()};
+    first.server->writev(&iov, 1);
+    first.client_read(ping.size()); // also processes the session ticket
+    session = SSL_get1_session(first.client);
+  }
+  ASSERT_NE(session, nullptr);
+  Loopback second(context, client_ctx, session);
+  ASSERT_TRUE(second.handshake());
+  EXPECT_TRUE(second.server->resumed());
+  SSL_SESSION_free(session);
+}
+
+#endif
@@ -0,0 +1,233 @@
+#include <gtest/gtest.h>
+
+#include "../lib/middleware.h"
+#include "../lib/websocket.h"
+
+using namespace http;
+using namespace std::string_literals;
+
+namespace {
+
+// A client frame: always masked, as the protocol requires
+std::string client_frame(Opcode opcode, std::string_view payload, bool fin = true) {
+  const uint8_t mask[4] = {0x37, 0xfa, 0x21, 0x3d};
+  std::string frame;
+  frame += static_cast<char>((fin ? 0x80 : 0) | static_cast<uint8_t>(opcode));
+  if (payload.size() < 126) {
+    frame += static_cast<char>(0x80 | payload.size());
+  } else {
+    frame += static_cast<char>(0x80 | 126);
+    frame += static_cast<char>(payload.size() >> 8);
+    frame += static_cast<char>(payload.size());
+  }
+  frame.append(reinterpret_cast<const char *>(mask), 4);
+  size_t start = frame.size();
+  frame += payload;
+  for (size_t i = 0; i < payload.size(); ++i) {
+    frame[start + i] ^= mask[i % 4];
+  }
+  return frame;
+}
+
+std::string output_bytes(const net::Output &output) {
+  std::string bytes;
+  for (const auto &segment : output.segments) {
+    if (auto *range = std::get_if<net::BufferSegment>(&segment)) {
+      bytes.append(output.buffer, range->offset, range->length);
+    }
+  }
+  return bytes;
+}
+
+Request upgrade_request(const std::string &uri) {
+  Headers headers;
+  headers.set("Upgrade", "websocket");
+  headers.set("Connection", "keep-alive, Upgrade");
+  headers.set("Sec-WebSocket-Version", "13");
+  headers.set("Sec-WebSocket-Key", "dGhlIHNhbXBsZSBub25jZQ==");
+  return Request{{Method::Get, uri, "HTTP/1.1"}, std::move(headers), {}, {}};
+}
+
+// Feeds `bytes` to the session the way the server does: the buffer keeps whatever was not consumed
+net::HandlerResult feed(net::Session &session, std::string &buffer, std::string_view bytes, net::Output &output) {
+  buffer += bytes;
+  auto result = session.on_input(std::span<char>(buffer.data(), buffer.size()), output);
+  buffer.erase(0, result.consumed);
+  return result;
+}
+
+} // namespace
+
+class WebSocketTest : public ::testing::Test {};
+
+TEST_F(WebSocketTest, AcceptKeyMatchesRfcExample) {
+  EXPECT_EQ(websocket_accept("dGhlIHNhbXBsZSBub25jZQ=="), "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+}
+
+TEST_F(WebSocketTest, ParsesFrameHeaders) {
+  auto small = parse_frame_header(client_frame(Opcode::Text, "Hello"));
+  ASSERT_TRUE(small);
+  EXPECT_TRUE(small->fin);
+  EXPECT_EQ(small->opcode, Opcode::Text);
+  EXPECT_TRUE(small->masked);
+  EXPECT_EQ(small->length, 5u);
+  EXPECT_EQ(small->header_size, 6u);
+
+  auto extended = parse_frame_header(client_frame(Opcode::Binary, std::string(300, 'x'), false));
+  ASSERT_TRUE(extended);
+  EXPECT_FALSE(extended->fin);
+  EXPECT_EQ(extended->length, 300u);
+  EXPECT_EQ(extended->header_size, 8u);
+
+  std::string wide = "\x82\x7f\x00\x00\x00\x00\x00\x01\x00\x00"s;
+  auto large = parse_frame_header(wide);
+  ASSERT_TRUE(large);
+  EXPECT_EQ(large->length, 65536u);
+  EXPECT_FALSE(large->masked);
+}
+
+TEST_F(WebSocketTest, ReportsIncompleteAndInvalidHeaders) {
+  auto frame = client_frame(Opcode::Text, "Hello");
+  EXPECT_EQ(parse_frame_header(frame.substr(0, 1)).error(), FrameError::Incomplete);
+  EXPECT_EQ(parse_frame_header(frame.substr(0, 4)).error(), FrameError::Incomplete);
+  frame[0] |= 0x40; // RSV1 without a negotiated extension
+  EXPECT_EQ(parse_frame_header(frame).error(), FrameError::ProtocolError);
+  EXPECT_EQ(parse_frame_header("\x83\x00"s).error(), FrameError::ProtocolError);
+}
+
+TEST_F(WebSocketTest, UnmaskMatchesBytewiseXor) {
+  const uint8_t mask[4] = {0x12, 0x34, 0x56, 0x78};
+  for (size_t length : {0, 1, 7, 8, 15, 16, 17, 63, 100}) {
+    for (size_t offset = 0; offset < 4; ++offset) {
+      std::string data(length, '\0');
+      for (size_t i = 0; i < length; ++i) {
+        data[i] = static_cast<char>(i * 7);
+      }
+      std::string expected = data;
+      for (size_t i = 0; i < length; ++i) {
+        expected[i] ^= mask[(offset + i) % 4];
+      }
+      unmask(data.data(), data.size(), mask, offset);
+      EXPECT_EQ(data, expected) << "length " << length << " offset " << offset;
+    }
+  }
+}
+
+TEST_F(WebSocketTest, WritesUnmaskedServerFrames) {
+  net::Output output;
+  write_frame(output, Opcode::Text, "hi");
+  write_frame(output, Opcode::Binary, std::string(200, 'b'));
+  auto bytes = output_bytes(output);
+  EXPECT_EQ(bytes.substr(0, 4), "\x81\x02hi"s);
+  EXPECT_EQ(bytes.substr(4, 4), "\x82\x7e\x00\xc8"s);
+  EXPECT_EQ(bytes.size(), 4u + 4u + 200u);
+}
+
+TEST_F(WebSocketTest, RejectsRequestsWithoutUpgradeHeaders) {
+  ws("/ws/reject-test", {});
+  Request request{{Method::Get, "/ws/reject-test", "HTTP/1.1"}, {}, {}, {}};
+  Response response{};
+  Exchange exchange{request, response};
+  dispatch(exchange);
+  EXPECT_EQ(response.responseLine.status.code, status::BAD_REQUEST.code);
+  EXPECT_FALSE(exchange.upgrade);
+}
+
+TEST_F(WebSocketTest, SwitchesProtocolsAndEchoesMessages) {
+  std::vector<std::string> messages;
+  bool closed = false;
+  ws("/ws/echo-test", {.on_open = [](WebSocket &socket) { socket.send_text("welcome"); },
+                       .on_message =
+                           [&messages](WebSocket &socket, std::string_view message, bool binary) {
+                             messages.emplace_back(message);
+                             socket.send_text(message);
+                           },
+                       .on_close = [&closed] { closed = true; }});
+  auto request = upgrade_request("/ws/echo-test");
+  Response response{};
+  Exchange exchange{request, response};
+  dispatch(exchange);
+  ASSERT_EQ(response.responseLine.status.code, status::SWITCHING_PROTOCOLS.code);
+  EXPECT_EQ(response.headers.data["Sec-WebSocket-Accept"], "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+  ASSERT_TRUE(exchange.upgrade);
+
+  auto &session = *exchange.upgrade;
+  net::Output output;
+  std::string buffer;
+  session.on_open(output, {});
+  EXPECT_EQ(output_bytes(output), "\x81\x07welcome"s);
+
+  output.clear();
+  auto frame = client_frame(Opcode::Text, "Hello");
+  // A frame split across reads is only handled once complete
+  EXPECT_EQ(feed(session, buffer, frame.substr(0, 3), output).consumed, 0u);
+  auto result = feed(session, buffer, frame.substr(3), output);
+  EXPECT_FALSE(result.close_connection);
+  EXPECT_TRUE(buffer.empty());
+  ASSERT_EQ(messages.size(), 1u);
+  EXPECT_EQ(messages[0], "Hello");
+  EXPECT_EQ(output_bytes(output), "\x81\x05Hello"s);
+
+  output.clear();
+  result = feed(session, buffer, client_frame(Opcode::Close, "\x03\xe8"s), output);
+  EXPECT_TRUE(result.close_connection);
+  EXPECT_EQ(output_bytes(output), "\x88\x02\x03\xe8"s);
+  session.on_close();
+  EXPECT_TRUE(closed);
+}
+
+TEST_F(WebSocketTest, ReassemblesFragmentsAroundControlFrames) {
+  std::vector<std::string> messages;
+  ws("/ws/fragment-test", {.on_message = [&messages](WebSocket &, std::string_view message, bool binary) {
+                             EXPECT_TRUE(binary);
+                             messages.emplace_back(message);
+                           }});
+  auto request = upgrade_request("/ws/fragment-test");
+  Response response{};
+  Exchange exchange{request, response};
+  dispatch(exchange);
+  ASSERT_TRUE(exchange.upgrade);
+
+  auto &session = *exchange.upgrade;
+  net::Output output;
+  std::string buffer;
+  EXPECT_EQ(feed(session, buffer, client_frame(Opcode::Binary, "Hel", false), output).consumed, 0u);
+  EXPECT_EQ(feed(session, buffer, client_frame(Opcode::Ping, "p"), output).consumed, 0u);
+  EXPECT_EQ(output_bytes(output), "\x8a\x01p"s);
+  EXPECT_TRUE(messages.empty());
+
+  std::string rest = client_frame(Opcode::Continuation, "lo, ", false) +
+                     client_frame(Opcode::Continuation, "world", true) + client_frame(Opcode::Binary, "next");
+  auto result = feed(session, buffer, rest, output);
+  EXPECT_FALSE(result.close_connection);
+  EXPECT_TRUE(buffer.empty());
+  ASSERT_EQ(messages.size(), 2u);
+  EXPECT_EQ(messages[0], "Hello, world");
+  EXPECT_EQ(messages[1], "next");
+
+  // A fragmented message that starts behind a complete one in the same read
+  result = feed(session, buffer, client_frame(Opcode::Binary, "AAAA") + client_frame(Opcode::Binary, "Hel", false),
+                output);
+  EXPECT_EQ(buffer.size(), client_frame(Opcode::Binary, "Hel", false).size());
+  feed(session, buffer, client_frame(Opcode::Continuation, "lo"), output);
+  EXPECT_TRUE(buffer.empty());
+  ASSERT_EQ(messages.size(), 4u);
+  EXPECT_EQ(messages[2], "AAAA");
+  EXPECT_EQ(messages[3], "Hello");
+}
+
+TEST_F(WebSocketTest, ClosesOnProtocolViolations) {
+  ws("/ws/violation-test", {});
+  auto request = upgrade_request("/ws/violation-test");
+  Response response{};
+  Exchange exchange{request, response};
+  dispatch(exchange);
+  ASSERT_TRUE(exchange.upgrade);
+
+  net::Output output;
+  std::string buffer;
+  // Client frames must be masked
+  auto result = feed(*exchange.upgrade, buffer, "\x81\x02hi"s, output);
+  EXPECT_TRUE(result.close_connection);
+  EXPECT_EQ(output_bytes(output), "\x88\x02\x03\xea"s);
+}
@@ -0,0 +1,136 @@
+// Build-time generator: embeds every file of an asset directory into a C++ include with
+// constexpr data, a precomputed gzip variant, an ETag and a content type per file. Assets are served
+// from the single-segment route /static/:name, so files in subdirectories are refused.
+//
+//   embed-assets <output.inc> <asset-dir> <files...>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <zlib.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct Entry {
+  std::string path;
+  std::string data;
+  std::string gzip;
+};
+
+std::string read_file(const fs::path &path) {
+  std::ifstream file(path, std::ios::binary);
+  std::ostringstream ss;
+  ss << file.rdbuf();
+  return ss.str();
+}
+
+std::string gzip(const std::string &data) {
+  z_stream zs{};
+  deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY);
+  zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+  zs.avail_in = data.size();
+
+  std::string compressed;
+  char buf[4096];
+  do {
+    zs.next_out = reinterpret_cast<Bytef *>(buf);
+    zs.avail_out = sizeof(buf);
+    deflate(&zs, Z_FINISH);
+    compressed.append(buf, sizeof(buf) - zs.avail_out);
+  } while (zs.avail_out == 0);
+  deflateEnd(&zs);
+  return compressed;
+}
+
+std::string content_type(const fs::path &path) {
+  static const std::unordered_map<std::string, std::string> types = {
+      {".html", "text/html; charset=utf-8"},
+      {".css", "text/css; charset=utf-8"},
+      {".js", "text/javascript; charset=utf-8"},
+      {".json", "application/json"},
+      {".txt", "text/plain; charset=utf-8"},
+      {".svg", "image/svg+xml"},
+      {".png", "image/png"},
+      {".jpg", "image/jpeg"},
+      {".ico", "image/x-icon"},
+      {".wasm", "application/wasm"},
+  };
+  auto it = types.find(path.extension().string());
+  return it == types.end() ? "application/octet-stream" : it->second;
+}
+
+std::string etag(const std::string &data) {
+  uint64_t hash = 0xcbf29ce484222325ULL; // FNV-1a
+  for (unsigned char c : data) {
+    hash = (hash ^ c) * 0x100000001b3ULL;
+  }
+  char buf[24];
+  snprintf(buf, sizeof(buf), "\"%016llx\"", static_cast<unsigned long long>(hash));
+  return buf;
+}
+
+void write_bytes(std::ostream &out, const std::string &name, const std::string &data) {
+  out << "constexpr char " << name << "[] = {";
+  for (size_t i = 0; i < data.size(); i++) {
+    if (i % 16 == 0) {
+      out << "\n    ";
+    }
+    char buf[8];
+    snprintf(buf, sizeof(buf), "'\\x%02x',", static_cast<unsigned char>(data[i]));
+    out << buf;
+  }
+  out << "0};\n";
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    std::cerr << "usage: embed-assets <output.inc> <asset-dir> <files...>\n";
+    return 1;
+  }
+  fs::path root = argv[2];
+  std::vector<Entry> entries;
+  for (int i = 3; i < argc; ++i) {
+    fs::path file = argv[i];
+    auto path = fs::relative(file, root).generic_string();
+    if (path.find('/') != std::string::npos) {
+      std::cerr << "embed-assets: " << path << ": nested assets cannot be served, move it to the top level\n";
+      return 1;
+    }
+    auto data = read_file(file);
+    auto compressed = gzip(data);
+    // Serving the gzip variant only pays off when it is actually smaller
+    if (compressed.size() >= data.size()) {
+      compressed.clear();
+    }
+    entries.push_back({std::move(path), std::move(data), std::move(compressed)});
+  }
+  // The lookup table is binary searched, so it must be sorted by path
+  std::sort(entries.begin(), entries.end(), [](const auto &a, const auto &b) { return a.path < b.path; });
+
+  std::ofstream out(argv[1]);
+  out << "// Generated by tools/embed_assets.cpp. Do not edit.\n\n";
+  for (size_t i = 0; i < entries.size(); i++) {
+    write_bytes(out, "asset_" + std::to_string(i), entries[i].data);
+    write_bytes(out, "asset_" + std::to_string(i) + "_gzip", entries[i].gzip);
+  }
+  out << "\nconstexpr std::array<http::Asset, " << entries.size() << "> EMBEDDED_ASSETS = {{\n";
+  for (size_t i = 0; i < entries.size(); i++) {
+    const auto &e = entries[i];
+    auto id = "asset_" + std::to_string(i);
+    out << "    {\"" << e.path << "\", {" << id << ", " << e.data.size() << "}, {" << id << "_gzip, " << e.gzip.size()
+        << "}, R\"(" << etag(e.data) << ")\", \"" << content_type(e.path) << "\"},\n";
+  }
+  out << "}};\n";
+  return 0;
+}